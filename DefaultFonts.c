@@ -6,7 +6,9 @@
 // Font Size	: 8x12
 // Memory usage	: 1144 bytes
 // # characters	: 95
+#ifndef fontdatatype
 #define fontdatatype const unsigned char
+#endif
 
 fontdatatype SmallFont[1144] ={         
 0x08,0x0C,0x20,0x5F,
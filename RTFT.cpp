@@ -1,634 +1,5893 @@
-/*
-  RTFT.cpp - Raspberry Pi library for video output.
-  Copyright (C)2015 Daniel Donantueno. All right reserved
-  
-  This library is an adaptation of the popular UTFT.cpp 
-  Arduino/chipKit library support for Color TFT LCD Boards by 
-  Rinky-Dink Electronics, Henning Karlsen. Frame Buffer handing
-  for the Raspberry Pi platform is based on comments found 
-  in http://raspberrycompote.blogspot.com.ar.
-  
-  Due to the popularity of UTFT library I felt it would be nice to
-  adapt that library in order to allow Arduino programs to work on 
-  the Raspberry pi platform.
-
-  This library is based in the Frame Buffer technology wich allows
-  a very good performance and ease of work.
-
-  Repository https://github.com/dhdonantueno/RTFT.git
-
-  This library is free software; you can redistribute it and/or
-  modify it under the terms of the CC BY-NC-SA 3.0 license.
-  Please see the included documents for further information.
-
-  Commercial use of this library requires you to buy a license that
-  will allow commercial use. This includes using the library,
-  modified or not, as a tool to sell products.
-
-  The license applies to all part of the library including the 
-  examples and tools supplied with the library.
-*/
-
-#include <RTFT.h>
-
-unsigned char RTFT::init(unsigned short int x, unsigned short int y) { 
-//+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-	
-	if (x%32) x = x + 32 - (x%32);
-	if (y%16) y = y + 16 - (y%16);
-
-    current_color = 0xFF;
-    current_back_color = 0;
-    _transparent = true;
-//+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++    
-    fbp = NULL;
-    fbfd = 0;
-    screensize = 0;
-
-    // Open the file for reading and writing
-    fbfd = open("/dev/fb0", O_RDWR);
-    if (!fbfd) {
-      fprintf(stderr,"RTFT Error 01: cannot open framebuffer device.\n");
-      return 1;
-    }
-//    printf("The framebuffer device was opened successfully.\n");
-
-    // Get variable screen information
-    if (ioctl(fbfd, FBIOGET_VSCREENINFO, &vinfo)) {
-      fprintf(stderr,"RTFT Error 02: reading variable information.\n");
-      return 2;
-    }
-//    printf("Original %dx%d, %dbpp\n", vinfo.xres, vinfo.yres, 
-//       vinfo.bits_per_pixel );
-
-    // Store for reset (copy vinfo to vinfo_orig)
-    memcpy(&orig_vinfo, &vinfo, sizeof(struct fb_var_screeninfo));
-    
-    // Change variable info
-    // use: 'fbset -depth x' to test different bpps
-	vinfo.bits_per_pixel = 16;
-	vinfo.xres = x;
-	vinfo.yres = y;
-	vinfo.xres_virtual = vinfo.xres;
-	vinfo.yres_virtual = vinfo.yres;
-
-	if (ioctl(fbfd, FBIOPUT_VSCREENINFO, &vinfo)) {
-		fprintf(stderr,"RTFT Error 03: setting variable information.\n");
-		return 3;
-	}
-	
-	if (ioctl(fbfd, FBIOGET_VSCREENINFO, &vinfo)) {
-      fprintf(stderr,"RTFT Error 04: reading variable information.\n");
-      return 4;
-    }
-//    printf("New %dx%d, %dbpp\n", vinfo.xres, vinfo.yres, 
-//       vinfo.bits_per_pixel );
-
-    // Get fixed screen information
-    if (ioctl(fbfd, FBIOGET_FSCREENINFO, &finfo)) {
-      fprintf(stderr,"RTFT Error 05: reading fixed information.\n");
-      return 5;
-    }
-
-    // map fb to user mem 
-    screensize = vinfo.xres * vinfo.yres * vinfo.bits_per_pixel / 8;
-    
-    fbp = (char*)mmap(0, 
-              screensize, 
-              PROT_READ | PROT_WRITE, 
-              MAP_SHARED, 
-              fbfd, 
-              0);
-
-    if (fbp == MAP_FAILED) {
-        fprintf(stderr,"RTFT Error 06: Failed to mmap.\n");
-        return 6;
-    } else {
-	clrScr();
-        return 0;
-    }
-}
-
-RTFT::~RTFT() {
-	memcpy(&vinfo, &orig_vinfo, sizeof(struct fb_var_screeninfo));
-	if (ioctl(fbfd, FBIOPUT_VSCREENINFO, &vinfo)) {
-		fprintf(stderr,"RTFT Error 90: setting variable information.\n");
-	}
-	munmap(fbp,screensize);
-}
-
-void RTFT::drawRect(unsigned short int x1, unsigned short int y1, 
-unsigned short int x2, unsigned short int y2)
-{
-	if (x1>x2) swap(unsigned short int, x1, x2);
-	if (y1>y2) swap(unsigned short int, y1, y2);
-
-	drawHLine(x1, y1, x2-x1);
-	drawHLine(x1, y2, x2-x1);
-	drawVLine(x1, y1, y2-y1);
-	drawVLine(x2, y1, y2-y1);
-}
-
-void RTFT::drawRoundRect(unsigned short int x1, unsigned short int y1, 
-unsigned short int x2, unsigned short int y2)
-{
-	if (x1>x2) swap(unsigned short int, x1, x2);
-	if (y1>y2) swap(unsigned short int, y1, y2);
-	
-	if ((x2-x1)>4 && (y2-y1)>4)	{
-		drawPixel(x1+1,y1+1);
-		drawPixel(x2-1,y1+1);
-		drawPixel(x1+1,y2-1);
-		drawPixel(x2-1,y2-1);
-		drawHLine(x1+2, y1, x2-x1-4);
-		drawHLine(x1+2, y2, x2-x1-4);
-		drawVLine(x1, y1+2, y2-y1-4);
-		drawVLine(x2, y1+2, y2-y1-4);
-	}
-}
-
-void RTFT::fillRect(unsigned short int x1, unsigned short int y1, 
-unsigned short int x2, unsigned short int y2)
-{
-	if (x1>x2) swap(unsigned short int, x1, x2);
-	if (y1>y2) swap(unsigned short int, y1, y2);
-
-    for (int y = y1; y <= y2 ; y++) {
-        drawHLine(x1, y, x2-x1);
-    }
-
-}
-
-void RTFT::fillRoundRect(unsigned short int x1, unsigned short int y1, 
-unsigned short int x2, unsigned short int y2)
-{
-	if (x1>x2) swap(unsigned short int, x1, x2);
-	if (y1>y2) swap(unsigned short int, y1, y2);
-
-	if ((x2-x1)>4 && (y2-y1)>4)	{
-		for (unsigned short int i=0; i<((y2-y1)/2)+1; i++) {
-			switch(i) {
-			case 0:
-				drawHLine(x1+2, y1+i, x2-x1-4);
-				drawHLine(x1+2, y2-i, x2-x1-4);
-				break;
-			case 1:
-				drawHLine(x1+1, y1+i, x2-x1-2);
-				drawHLine(x1+1, y2-i, x2-x1-2);
-				break;
-			default:
-				drawHLine(x1, y1+i, x2-x1);
-				drawHLine(x1, y2-i, x2-x1);
-			}
-		}
-	}
-}
-
-void RTFT::drawCircle(unsigned short int x, unsigned short int y, 
-unsigned short int radius)
-{
-	short int f = 1 - radius;
-	short int ddF_x = 1;
-	short int ddF_y = -2 * radius;
-	short int x1 = 0;
-	short int y1 = radius;
- 
-    drawPixel(x, y + radius);
-    drawPixel(x, y - radius);
-    drawPixel(x + radius, y);
-    drawPixel(x - radius, y);
- 
-	while(x1 < y1) {
-		if(f >= 0) {
-			y1--;
-			ddF_y += 2;
-			f += ddF_y;
-		}
-		x1++;
-		ddF_x += 2;
-		f += ddF_x;    
-        drawPixel(x + x1, y + y1);
-        drawPixel(x - x1, y + y1);
-        drawPixel(x + x1, y - y1);
-        drawPixel(x - x1, y - y1);
-        drawPixel(x + y1, y + x1);
-        drawPixel(x - y1, y + x1);
-        drawPixel(x + y1, y - x1);
-        drawPixel(x - y1, y - x1);
-	}
-
-}
-
-void RTFT::fillCircle(unsigned short int x, unsigned short int y, 
-unsigned short int radius) {
-	int r2 = radius * radius;
-	for( short int y1=-radius; y1<=0; y1++) {
-		int y2 = y1 * y1;
-
-		for( short int x1=-radius; x1<=0; x1++)
-			if(x1*x1+y2 <= r2) {
-				drawHLine(x+x1, y+y1, 2*(-x1));
-				drawHLine(x+x1, y-y1, 2*(-x1));
-				break;
-			}
-	}
-}
-
-void RTFT::clrScr() {
-    fillScr(0);
-}
-
-void RTFT::fillScr(unsigned char r, unsigned char g, unsigned char b) {
-    unsigned short int color = ((r&248)<<8 | (g&252)<<3 | (b&248)>>3);
-	fillScr(color);
-}
-
-void RTFT::fillScr(unsigned short int color) {
-    memset(fbp, color, screensize);
-}
-
-void RTFT::setColor(unsigned char r, unsigned char g, unsigned char b) {
-    current_color = ((r&248)<<8 | (g&252)<<3 | (b&248)>>3);
-}
-
-void RTFT::setColor(unsigned short int color) {
-    current_color = color;
-}
-
-unsigned short int RTFT::getColor() {
-    return current_color;
-}
-
-void RTFT::setBackColor(unsigned char r, unsigned char g, unsigned char b) {
-    current_back_color = ((r&248)<<8 | (g&252)<<3 | (b&248)>>3);
-}
-
-void RTFT::setBackColor(unsigned short int color) {
-    current_back_color = color;
-}
-
-unsigned short int RTFT::getBackColor() {
-    return current_back_color;
-}
-
-/*
-void RTFT::setPixel(word color)
-{
-	LCD_Write_DATA((color>>8),(color&0xFF));	// rrrrrggggggbbbbb
-}
-*/
-
-void RTFT::drawPixel(unsigned short int x, unsigned short int y) {
-    if (x>vinfo.xres) x=vinfo.xres;
-	if (y>vinfo.yres) x=vinfo.yres;
-    // calculate the pixel's byte offset inside the buffer
-    // note: x * 2 as every pixel is 2 consecutive bytes
-    unsigned int pix_offset = x * 2 + y * finfo.line_length;
-
-    // now this is about the same as 'fbp[pix_offset] = value'
-    // but a bit more complicated for RGB565
-    //unsigned short c = ((r / 8) << 11) + ((g / 4) << 5) + (b / 8);
-    //unsigned short c = ((r / 8) * 2048) + ((g / 4) * 32) + (b / 8);
-    // write 'two bytes at once'
-    *((unsigned short*)(fbp + pix_offset)) = current_color;
-}
-
-void RTFT::drawPixel(unsigned short int x, unsigned short int y, 
-unsigned short int color) {
-	if (x>vinfo.xres) x=vinfo.xres;
-	if (y>vinfo.yres) x=vinfo.yres;
-    // calculate the pixel's byte offset inside the buffer
-    // note: x * 2 as every pixel is 2 consecutive bytes
-    unsigned int pix_offset = x * 2 + y * finfo.line_length;
-
-    // now this is about the same as 'fbp[pix_offset] = value'
-    // but a bit more complicated for RGB565
-    //unsigned short c = ((r / 8) << 11) + ((g / 4) << 5) + (b / 8);
-    //unsigned short c = ((r / 8) * 2048) + ((g / 4) * 32) + (b / 8);
-    // write 'two bytes at once'
-    *((unsigned short*)(fbp + pix_offset)) = color;
-}
-
-void RTFT::drawLine(unsigned short int x1, unsigned short int y1, 
-unsigned short int x2, unsigned short int y2) {
-	if (y1==y2)
-		drawHLine(x1, y1, x2-x1);
-	else if (x1==x2)
-		drawVLine(x1, y1, y2-y1);
-	else {
-		unsigned int	dx = (x2 > x1 ? x2 - x1 : x1 - x2);
-		short			xstep =  x2 > x1 ? 1 : -1;
-		unsigned int	dy = (y2 > y1 ? y2 - y1 : y1 - y2);
-		short			ystep =  y2 > y1 ? 1 : -1;
-		int				col = x1, row = y1;
-
-		if (dx < dy) {
-			int t = - (dy >> 1);
-			while (true) {
-                drawPixel(col, row);
-
-				if (row == y2)
-					return;
-				row += ystep;
-				t += dx;
-				if (t >= 0) {
-					col += xstep;
-					t   -= dy;
-				}
-			} 
-		} else {
-			int t = - (dx >> 1);
-			while (true) {
-                drawPixel(col, row);
-
-				if (col == x2) return;
-				col += xstep;
-				t += dy;
-				if (t >= 0) {
-					row += ystep;
-					t   -= dx;
-				}
-			} 
-		}
-	}
-}
-
-void RTFT::drawHLine(unsigned short int x, unsigned short int y, 
-short int l) {
-	if (l<0) {
-		l = -l;
-		x -= l;
-	}
-    for (short int x1=x; x1<= x+l; x1++) {
-        drawPixel(x1, y);
-    }
-}
-
-void RTFT::drawVLine(unsigned short int x, unsigned short int y, 
-short int l) {
-	if (l<0) {
-		l = -l;
-		y -= l;
-	}
-    for (short int y1=y; y1<= y+l; y1++) {
-        drawPixel(x, y1);
-    }
-}
-
-void RTFT::printChar(unsigned char c, unsigned short int x, 
-unsigned short int y) {
-	unsigned char i,ch;
-	unsigned short j, fila, columna, idx;
-	unsigned short temp; 
-
-	if (!_transparent) {
-			idx = 0;
-			temp=((c-cfont.offset)*((cfont.x_size/8)*cfont.y_size))+4;
-			for(j=0;j<((cfont.x_size/8)*cfont.y_size);j++) {
-				ch=cfont.font[temp];
-				for(i=0;i<8;i++) {   
-					fila = y + (idx / cfont.x_size);
-					columna = x + (idx % cfont.x_size);
-					
-					if((ch&(1<<(7-i)))!=0) {
-						drawPixel(columna, fila, current_color);
-					} else {
-						drawPixel(columna, fila, current_back_color);
-					}   
-					idx++;
-				}
-				temp++;
-			}
-	} else {
-			idx = 0;
-			temp=((c-cfont.offset)*((cfont.x_size/8)*cfont.y_size))+4;
-			for(j=0;j<((cfont.x_size/8)*cfont.y_size);j++) {
-				ch=cfont.font[temp];
-				for(i=0;i<8;i++) {   
-					fila = y + (idx / cfont.x_size);
-					columna = x + (idx % cfont.x_size);
-					
-					if((ch&(1<<(7-i)))!=0) {
-						drawPixel(columna, fila, current_color);
-					} 
-					idx++;
-				}
-				temp++;
-			}
-	}
-}
-
-void RTFT::rotateChar(unsigned char c, unsigned short x, 
-unsigned short y, int pos, unsigned short deg) {
-	unsigned char i,j,ch;
-	unsigned short temp; 
-	unsigned short newx,newy;
-	float radian;
-	radian=deg*0.0175;  
-
-	temp=((c-cfont.offset)*((cfont.x_size/8)*cfont.y_size))+4;
-	for(j=0;j<cfont.y_size;j++) {
-		for (int zz=0; zz<(cfont.x_size/8); zz++) {
-			ch=cfont.font[temp+zz]; 
-			for(i=0;i<8;i++) {   
-				newx=x+(((i+(zz*8)+(pos*cfont.x_size))*cos(radian))-((j)*sin(radian)));
-				newy=y+(((j)*cos(radian))+((i+(zz*8)+(pos*cfont.x_size))*sin(radian)));
-
-//				setXY(newx,newy,newx+1,newy+1);
-				
-				if((ch&(1<<(7-i)))!=0) {
-//					setPixel((fch<<8)|fcl);
-					drawPixel(newx, newy, current_color);
-				} else {
-					if (!_transparent)
-//						setPixel((bch<<8)|bcl);
-						drawPixel(newx, newy, current_back_color);
-				}   
-			}
-		}
-		temp+=(cfont.x_size/8);
-	}
-}
-
-void RTFT::print(char *st, unsigned short int x, unsigned short int y, 
-unsigned short int deg) {
-	int stl, i;
-	stl = strlen(st);
-
-	if (x==RIGHT)
-		x=(vinfo.xres)-(stl*cfont.x_size);
-	if (x==CENTER)
-		x=((vinfo.xres)-(stl*cfont.x_size))/2;
-	
-
-	for (i=0; i<stl; i++)
-		if (deg==0)
-			printChar(*st++, x + (i*(cfont.x_size)), y);
-		else
-			rotateChar(*st++, x, y, i, deg);
-}
-
-void RTFT::printNumI(long num, unsigned short int x, unsigned short int y, 
-unsigned char length, char filler) {
-	char buf[25];
-	char st[27];
-	bool neg=false;
-	int c=0, f=0;
-  
-	if (num==0) {
-		if (length!=0) {
-			for (c=0; c<(length-1); c++)
-				st[c]=filler;
-			st[c]=48;
-			st[c+1]=0;
-		} else {
-			st[0]=48;
-			st[1]=0;
-		}
-	} else {
-		if (num<0) {
-			neg=true;
-			num=-num;
-		}
-	  
-		while (num>0) {
-			buf[c]=48+(num % 10);
-			c++;
-			num=(num-(num % 10))/10;
-		}
-		buf[c]=0;
-	  
-		if (neg) {
-			st[0]=45;
-		}
-	  
-		if (length>(c+neg)) {
-			for (int i=0; i<(length-c-neg); i++) {
-				st[i+neg]=filler;
-				f++;
-			}
-		}
-
-		for (int i=0; i<c; i++) {
-			st[i+neg+f]=buf[c-i-1];
-		}
-		st[c+neg+f]=0;
-	}
-
-	print(st,x,y);
-}
-
-void RTFT::printNumF(float num, unsigned char dec, unsigned short int x, 
-unsigned short int y, char divider, unsigned short int length, char filler) {
-	char st[27];
-	bool neg=false;
-
-	if (dec<1)
-		dec=1;
-	else if (dec>5)
-		dec=5;
-
-	if (num<0)
-		neg = true;
-
-	_convert_float(st, num, length, dec);
-
-	if (divider != '.') {
-		for (unsigned short int i=0; i<sizeof(st); i++)
-			if (st[i]=='.')
-				st[i]=divider;
-	}
-
-	if (filler != ' ') {
-		if (neg) {
-			st[0]='-';
-			for (unsigned short int i=1; i<sizeof(st); i++)
-				if ((st[i]==' ') || (st[i]=='-'))
-					st[i]=filler;
-		} else {
-			for (unsigned short int i=0; i<sizeof(st); i++)
-				if (st[i]==' ')
-					st[i]=filler;
-		}
-	}
-	print(st,x,y);
-}
-
-void RTFT::setFont(const unsigned char* font, bool t)
-{
-	cfont.font=font;
-	cfont.x_size=fontbyte(0);
-	cfont.y_size=fontbyte(1);
-	cfont.offset=fontbyte(2);
-	cfont.numchars=fontbyte(3);
-
-	_transparent = t;
-}
-
-const unsigned char* RTFT::getFont() {
-	return cfont.font;
-}
-
-unsigned char RTFT::getFontXsize() {
-	return cfont.x_size;
-}
-
-unsigned char RTFT::getFontYsize() {
-	return cfont.y_size;
-}
-
-void RTFT::drawBitmap(unsigned short int x, unsigned short int y, 
-unsigned short int sx, unsigned short int sy, bitmapdatatype data) {
-	unsigned short col;
-
-			for (unsigned short tc=0; tc<(sx*sy); tc++) {
-				col=data[tc];
-				short fila    = tc / sx;
-				short columna = tc % sx;
-				drawPixel(x+columna, y+fila, col);
-			}
-}
-
-void RTFT::drawBitmap(unsigned short int x, unsigned short int y, 
-unsigned short int sx, unsigned short int sy, bitmapdatatype data, unsigned short int deg, unsigned short int rox, unsigned short int roy) {
-	unsigned short col;
-	int tx, ty, newx, newy;
-	double radian;
-	radian=deg*0.0175;  
-
-	if (deg==0)
-		drawBitmap(x, y, sx, sy, data);
-	else {
-		for (ty=0; ty<sy; ty++)
-			for (tx=0; tx<sx; tx++) {
-				col=data[(ty*sx)+tx];
-
-				newx=x+rox+(((tx-rox)*cos(radian))-((ty-roy)*sin(radian)));
-				newy=y+roy+(((ty-roy)*cos(radian))+((tx-rox)*sin(radian)));
-
-				drawPixel(newx, newy, col);
-			}
-	}
-}
-
-int RTFT::getDisplayXSize() {
-		return vinfo.xres;
-}
-
-int RTFT::getDisplayYSize() {
-		return vinfo.yres;
-}
-
-void RTFT::setDisplayPage(unsigned char page) {
-}
-
-void RTFT::setWritePage(unsigned char page) {
-}
-
-void RTFT::_convert_float(char *buf, float num, unsigned short int width, 
-unsigned char prec) {
-	
-	char format[10];
-	sprintf(format, "%%%i.%if", width, prec);
-	sprintf(buf, format, num);
-}
+/*
+  RTFT.cpp - Raspberry Pi library for video output.
+  Copyright (C)2015 Daniel Donantueno. All right reserved
+  
+  This library is an adaptation of the popular UTFT.cpp 
+  Arduino/chipKit library support for Color TFT LCD Boards by 
+  Rinky-Dink Electronics, Henning Karlsen. Frame Buffer handing
+  for the Raspberry Pi platform is based on comments found 
+  in http://raspberrycompote.blogspot.com.ar.
+  
+  Due to the popularity of UTFT library I felt it would be nice to
+  adapt that library in order to allow Arduino programs to work on 
+  the Raspberry pi platform.
+
+  This library is based in the Frame Buffer technology wich allows
+  a very good performance and ease of work.
+
+  Repository https://github.com/dhdonantueno/RTFT.git
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the CC BY-NC-SA 3.0 license.
+  Please see the included documents for further information.
+
+  Commercial use of this library requires you to buy a license that
+  will allow commercial use. This includes using the library,
+  modified or not, as a tool to sell products.
+
+  The license applies to all part of the library including the 
+  examples and tools supplied with the library.
+*/
+
+#include <RTFT.h>
+#include <stdint.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#if !defined(__aarch64__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+
+//*********************************
+// SPAN FILL KERNELS
+//*********************************
+// Fill n 16 or 32 bit pixels with the same color. The wide versions 
+// align the destination with single pixel stores and then write whole
+// vectors.
+
+typedef unsigned int __attribute__((may_alias)) _u32a;
+
+template<typename T>
+static void _fill_scalar(T *dst, int n, T color) {
+	if (sizeof(T)==2 && n>0 && ((uintptr_t)dst & 2)) {
+		*dst++ = color;
+		n--;
+	}
+	_u32a *d = (_u32a*)dst;
+	unsigned int pattern = sizeof(T)==2 ? (color | (color << 16)) : color;
+	int words = n * sizeof(T) / 4;
+	for (int i=0; i<words; i++)
+		d[i] = pattern;
+	if (sizeof(T)==2 && (n & 1))
+		dst[n-1] = color;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+template<typename T>
+__attribute__((target("sse2")))
+static void _fill_sse2(T *dst, int n, T color) {
+	const int lanes = 16 / sizeof(T);
+	while (n>0 && ((uintptr_t)dst & 15)) {
+		*dst++ = color;
+		n--;
+	}
+	__m128i v = sizeof(T)==2 ? _mm_set1_epi16(color) : _mm_set1_epi32(color);
+	for (; n>=2*lanes; n-=2*lanes, dst+=2*lanes) {
+		_mm_store_si128((__m128i*)dst, v);
+		_mm_store_si128((__m128i*)(dst + lanes), v);
+	}
+	if (n>=lanes) {
+		_mm_store_si128((__m128i*)dst, v);
+		dst += lanes;
+		n -= lanes;
+	}
+	while (n-->0)
+		*dst++ = color;
+}
+
+template<typename T>
+__attribute__((target("avx2")))
+static void _fill_avx2(T *dst, int n, T color) {
+	const int lanes = 32 / sizeof(T);
+	while (n>0 && ((uintptr_t)dst & 31)) {
+		*dst++ = color;
+		n--;
+	}
+	__m256i v = sizeof(T)==2 ? _mm256_set1_epi16(color) : _mm256_set1_epi32(color);
+	for (; n>=2*lanes; n-=2*lanes, dst+=2*lanes) {
+		_mm256_store_si256((__m256i*)dst, v);
+		_mm256_store_si256((__m256i*)(dst + lanes), v);
+	}
+	if (n>=lanes) {
+		_mm256_store_si256((__m256i*)dst, v);
+		dst += lanes;
+		n -= lanes;
+	}
+	while (n-->0)
+		*dst++ = color;
+}
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+template<typename T>
+static void _fill_neon(T *dst, int n, T color) {
+	const int lanes = 16 / sizeof(T);
+	while (n>0 && ((uintptr_t)dst & 15)) {
+		*dst++ = color;
+		n--;
+	}
+	uint8x16_t v = sizeof(T)==2 ? vreinterpretq_u8_u16(vdupq_n_u16(color)) :
+		vreinterpretq_u8_u32(vdupq_n_u32(color));
+	for (; n>=2*lanes; n-=2*lanes, dst+=2*lanes) {
+		vst1q_u8((uint8_t*)dst, v);
+		vst1q_u8((uint8_t*)(dst + lanes), v);
+	}
+	if (n>=lanes) {
+		vst1q_u8((uint8_t*)dst, v);
+		dst += lanes;
+		n -= lanes;
+	}
+	while (n-->0)
+		*dst++ = color;
+}
+#endif
+
+//*********************************
+// COLOR KEY KERNELS
+//*********************************
+// Copy n 16 or 32 bit pixels, skipping the ones equal to the key. The
+// wide versions compare a vector at a time and select between source 
+// and destination.
+
+template<typename T>
+static void _key_scalar(T *dst, const T *src, int n, T key) {
+	for (int i=0; i<n; i++)
+		if (src[i]!=key)
+			dst[i] = src[i];
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+template<typename T>
+__attribute__((target("sse2")))
+static void _key_sse2(T *dst, const T *src, int n, T key) {
+	const int lanes = 16 / sizeof(T);
+	__m128i k = sizeof(T)==2 ? _mm_set1_epi16(key) : _mm_set1_epi32(key);
+	for (; n>=lanes; n-=lanes, dst+=lanes, src+=lanes) {
+		__m128i s = _mm_loadu_si128((const __m128i*)src);
+		__m128i d = _mm_loadu_si128((const __m128i*)dst);
+		__m128i m = sizeof(T)==2 ? _mm_cmpeq_epi16(s, k) : _mm_cmpeq_epi32(s, k);
+		_mm_storeu_si128((__m128i*)dst, _mm_or_si128(_mm_and_si128(m, d), 
+			_mm_andnot_si128(m, s)));
+	}
+	_key_scalar(dst, src, n, key);
+}
+
+template<typename T>
+__attribute__((target("avx2")))
+static void _key_avx2(T *dst, const T *src, int n, T key) {
+	const int lanes = 32 / sizeof(T);
+	__m256i k = sizeof(T)==2 ? _mm256_set1_epi16(key) : _mm256_set1_epi32(key);
+	for (; n>=lanes; n-=lanes, dst+=lanes, src+=lanes) {
+		__m256i s = _mm256_loadu_si256((const __m256i*)src);
+		__m256i d = _mm256_loadu_si256((const __m256i*)dst);
+		__m256i m = sizeof(T)==2 ? _mm256_cmpeq_epi16(s, k) : _mm256_cmpeq_epi32(s, k);
+		_mm256_storeu_si256((__m256i*)dst, _mm256_blendv_epi8(s, d, m));
+	}
+	_key_scalar(dst, src, n, key);
+}
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+static void _key_neon(unsigned short *dst, const unsigned short *src, int n, 
+unsigned short key) {
+	uint16x8_t k = vdupq_n_u16(key);
+	for (; n>=8; n-=8, dst+=8, src+=8) {
+		uint16x8_t s = vld1q_u16(src);
+		uint16x8_t m = vceqq_u16(s, k);
+		vst1q_u16(dst, vbslq_u16(m, vld1q_u16(dst), s));
+	}
+	_key_scalar(dst, src, n, key);
+}
+
+static void _key_neon(unsigned int *dst, const unsigned int *src, int n, 
+unsigned int key) {
+	uint32x4_t k = vdupq_n_u32(key);
+	for (; n>=4; n-=4, dst+=4, src+=4) {
+		uint32x4_t s = vld1q_u32(src);
+		uint32x4_t m = vceqq_u32(s, k);
+		vst1q_u32(dst, vbslq_u32(m, vld1q_u32(dst), s));
+	}
+	_key_scalar(dst, src, n, key);
+}
+#endif
+
+//*********************************
+// BLEND KERNELS
+//*********************************
+// Blend n RGB565 pixels towards src, or towards color when src is NULL,
+// with weight alpha in 0..256, scaled per pixel by mask when given. 
+// Every channel moves by ((s - d) * w) >> 8 as in _mix565, the wide 
+// versions do the same in 16 bit lanes, 8 or 16 pixels at a time, and
+// give the same pixels.
+
+// Blends RGB565 colors, w is the weight of b in 0..256.
+static inline unsigned short _mix565(unsigned short a, unsigned short b, int w) {
+	int r = (a >> 11) + ((((b >> 11) - (a >> 11)) * w) >> 8);
+	int g = ((a >> 5) & 0x3F) + (((((b >> 5) & 0x3F) - ((a >> 5) & 0x3F)) * w) >> 8);
+	int bl = (a & 0x1F) + ((((b & 0x1F) - (a & 0x1F)) * w) >> 8);
+	return r << 11 | g << 5 | bl;
+}
+
+// Weight of a mask byte at global weight alpha.
+static inline int _weight(int m, int alpha) {
+	m += m >> 7;
+	return alpha==256 ? m : (m * alpha) >> 8;
+}
+
+static void _blend_scalar(unsigned short *dst, const unsigned short *src, int n, 
+unsigned short color, const unsigned char *mask, int alpha) {
+	for (int i=0; i<n; i++)
+		dst[i] = _mix565(dst[i], src ? src[i] : color, mask ? _weight(mask[i], alpha) : alpha);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+static inline __m128i _mix565_sse2(__m128i d, __m128i s, __m128i w) {
+	const __m128i g6 = _mm_set1_epi16(0x3F), b5 = _mm_set1_epi16(0x1F);
+	__m128i dr = _mm_srli_epi16(d, 11), sr = _mm_srli_epi16(s, 11);
+	__m128i dg = _mm_and_si128(_mm_srli_epi16(d, 5), g6);
+	__m128i sg = _mm_and_si128(_mm_srli_epi16(s, 5), g6);
+	__m128i db = _mm_and_si128(d, b5), sb = _mm_and_si128(s, b5);
+	__m128i r = _mm_add_epi16(dr, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(sr, dr), w), 8));
+	__m128i g = _mm_add_epi16(dg, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(sg, dg), w), 8));
+	__m128i b = _mm_add_epi16(db, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(sb, db), w), 8));
+	return _mm_or_si128(_mm_or_si128(_mm_slli_epi16(r, 11), _mm_slli_epi16(g, 5)), b);
+}
+
+__attribute__((target("sse2")))
+static void _blend_sse2(unsigned short *dst, const unsigned short *src, int n, 
+unsigned short color, const unsigned char *mask, int alpha) {
+	const __m128i zero = _mm_setzero_si128(), a = _mm_set1_epi16(alpha);
+	__m128i s = _mm_set1_epi16(color), w = a;
+	for (; n>=8; n-=8, dst+=8) {
+		if (src) {
+			s = _mm_loadu_si128((const __m128i*)src);
+			src += 8;
+		}
+		if (mask) {
+			w = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)mask), zero);
+			w = _mm_add_epi16(w, _mm_srli_epi16(w, 7));
+			if (alpha<256)
+				w = _mm_srli_epi16(_mm_mullo_epi16(w, a), 8);
+			mask += 8;
+		}
+		__m128i d = _mm_loadu_si128((const __m128i*)dst);
+		_mm_storeu_si128((__m128i*)dst, _mix565_sse2(d, s, w));
+	}
+	_blend_scalar(dst, src, n, color, mask, alpha);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i _mix565_avx2(__m256i d, __m256i s, __m256i w) {
+	const __m256i g6 = _mm256_set1_epi16(0x3F), b5 = _mm256_set1_epi16(0x1F);
+	__m256i dr = _mm256_srli_epi16(d, 11), sr = _mm256_srli_epi16(s, 11);
+	__m256i dg = _mm256_and_si256(_mm256_srli_epi16(d, 5), g6);
+	__m256i sg = _mm256_and_si256(_mm256_srli_epi16(s, 5), g6);
+	__m256i db = _mm256_and_si256(d, b5), sb = _mm256_and_si256(s, b5);
+	__m256i r = _mm256_add_epi16(dr, _mm256_srai_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(sr, dr), w), 8));
+	__m256i g = _mm256_add_epi16(dg, _mm256_srai_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(sg, dg), w), 8));
+	__m256i b = _mm256_add_epi16(db, _mm256_srai_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(sb, db), w), 8));
+	return _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi16(r, 11), _mm256_slli_epi16(g, 5)), b);
+}
+
+__attribute__((target("avx2")))
+static void _blend_avx2(unsigned short *dst, const unsigned short *src, int n, 
+unsigned short color, const unsigned char *mask, int alpha) {
+	const __m256i a = _mm256_set1_epi16(alpha);
+	__m256i s = _mm256_set1_epi16(color), w = a;
+	for (; n>=16; n-=16, dst+=16) {
+		if (src) {
+			s = _mm256_loadu_si256((const __m256i*)src);
+			src += 16;
+		}
+		if (mask) {
+			w = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)mask));
+			w = _mm256_add_epi16(w, _mm256_srli_epi16(w, 7));
+			if (alpha<256)
+				w = _mm256_srli_epi16(_mm256_mullo_epi16(w, a), 8);
+			mask += 16;
+		}
+		__m256i d = _mm256_loadu_si256((const __m256i*)dst);
+		_mm256_storeu_si256((__m256i*)dst, _mix565_avx2(d, s, w));
+	}
+	_blend_scalar(dst, src, n, color, mask, alpha);
+}
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+static inline uint16x8_t _mix565_neon(uint16x8_t d, uint16x8_t s, int16x8_t w) {
+	const uint16x8_t g6 = vdupq_n_u16(0x3F), b5 = vdupq_n_u16(0x1F);
+	int16x8_t dr = vreinterpretq_s16_u16(vshrq_n_u16(d, 11));
+	int16x8_t sr = vreinterpretq_s16_u16(vshrq_n_u16(s, 11));
+	int16x8_t dg = vreinterpretq_s16_u16(vandq_u16(vshrq_n_u16(d, 5), g6));
+	int16x8_t sg = vreinterpretq_s16_u16(vandq_u16(vshrq_n_u16(s, 5), g6));
+	int16x8_t db = vreinterpretq_s16_u16(vandq_u16(d, b5));
+	int16x8_t sb = vreinterpretq_s16_u16(vandq_u16(s, b5));
+	int16x8_t r = vaddq_s16(dr, vshrq_n_s16(vmulq_s16(vsubq_s16(sr, dr), w), 8));
+	int16x8_t g = vaddq_s16(dg, vshrq_n_s16(vmulq_s16(vsubq_s16(sg, dg), w), 8));
+	int16x8_t b = vaddq_s16(db, vshrq_n_s16(vmulq_s16(vsubq_s16(sb, db), w), 8));
+	return vorrq_u16(vorrq_u16(vshlq_n_u16(vreinterpretq_u16_s16(r), 11), 
+		vshlq_n_u16(vreinterpretq_u16_s16(g), 5)), vreinterpretq_u16_s16(b));
+}
+
+static void _blend_neon(unsigned short *dst, const unsigned short *src, int n, 
+unsigned short color, const unsigned char *mask, int alpha) {
+	uint16x8_t s = vdupq_n_u16(color);
+	int16x8_t w = vdupq_n_s16(alpha);
+	for (; n>=8; n-=8, dst+=8) {
+		if (src) {
+			s = vld1q_u16(src);
+			src += 8;
+		}
+		if (mask) {
+			uint16x8_t m = vmovl_u8(vld1_u8(mask));
+			m = vsraq_n_u16(m, m, 7);
+			if (alpha<256)
+				m = vshrq_n_u16(vmulq_n_u16(m, alpha), 8);
+			w = vreinterpretq_s16_u16(m);
+			mask += 8;
+		}
+		vst1q_u16(dst, _mix565_neon(vld1q_u16(dst), s, w));
+	}
+	_blend_scalar(dst, src, n, color, mask, alpha);
+}
+#endif
+
+typedef void (*_fill16_fn)(unsigned short *dst, int n, unsigned short color);
+typedef void (*_fill32_fn)(unsigned int *dst, int n, unsigned int color);
+typedef void (*_key16_fn)(unsigned short *dst, const unsigned short *src, int n, unsigned short key);
+typedef void (*_key32_fn)(unsigned int *dst, const unsigned int *src, int n, unsigned int key);
+typedef void (*_blend16_fn)(unsigned short *dst, const unsigned short *src, int n, 
+	unsigned short color, const unsigned char *mask, int alpha);
+
+static const char *fill_name = "scalar";
+static _fill16_fn fill16 = _fill_scalar<unsigned short>;
+static _fill32_fn fill32 = _fill_scalar<unsigned int>;
+static _key16_fn key16 = _key_scalar<unsigned short>;
+static _key32_fn key32 = _key_scalar<unsigned int>;
+static _blend16_fn blend16 = _blend_scalar;
+
+static bool _pick_fill() {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		fill_name = "avx2";
+		fill16 = _fill_avx2<unsigned short>;
+		fill32 = _fill_avx2<unsigned int>;
+		key16 = _key_avx2<unsigned short>;
+		key32 = _key_avx2<unsigned int>;
+		blend16 = _blend_avx2;
+		return true;
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		fill_name = "sse2";
+		fill16 = _fill_sse2<unsigned short>;
+		fill32 = _fill_sse2<unsigned int>;
+		key16 = _key_sse2<unsigned short>;
+		key32 = _key_sse2<unsigned int>;
+		blend16 = _blend_sse2;
+		return true;
+	}
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#if !defined(__aarch64__)
+	if (getauxval(AT_HWCAP) & HWCAP_NEON)
+#endif
+	{
+		fill_name = "neon";
+		fill16 = _fill_neon<unsigned short>;
+		fill32 = _fill_neon<unsigned int>;
+		key16 = _key_neon;
+		key32 = _key_neon;
+		blend16 = _blend_neon;
+		return true;
+	}
+#endif
+	return false;
+}
+
+static bool fill_picked = _pick_fill();
+
+//*********************************
+// PIXEL FORMATS
+//*********************************
+// Every format gets its own copy of the rasterizer inner loops below.
+// Colors are handed in already converted to the native pixel value, 
+// bitmaps are RGB565 as in UTFT and converted while copying.
+
+static inline unsigned int _expand565(unsigned short c, int rs, int gs, int bs) {
+	unsigned int r = (c >> 11) & 0x1F, g = (c >> 5) & 0x3F, b = c & 0x1F;
+	return ((r << 3 | r >> 2) << rs) | ((g << 2 | g >> 4) << gs) | ((b << 3 | b >> 2) << bs);
+}
+
+static inline unsigned short _reduce565(unsigned int c, int rs, int gs, int bs) {
+	return ((c >> rs) & 248) << 8 | ((c >> gs) & 252) << 3 | ((c >> bs) & 248) >> 3;
+}
+
+struct _rgb565 {
+	enum { bytes = 2, id = PIXFMT_RGB565 };
+	static inline void store(char *p, unsigned int c) {
+		*((unsigned short*)p) = c;
+	}
+	static inline unsigned int convert(unsigned short c) {
+		return c;
+	}
+	static inline unsigned int rgb(unsigned char r, unsigned char g, unsigned char b) {
+		return (r&248)<<8 | (g&252)<<3 | (b&248)>>3;
+	}
+	static inline void fill(char *p, int n, unsigned int c) {
+		fill16((unsigned short*)p, n, c);
+	}
+	static inline unsigned int fetch(const char *p) {
+		return *((const unsigned short*)p);
+	}
+	static inline unsigned short rgb565(unsigned int c) {
+		return c;
+	}
+	static inline void rgb24(unsigned int c, unsigned char *d) {
+		unsigned int e = _expand565(c, 16, 8, 0);
+		d[0] = e >> 16;
+		d[1] = e >> 8;
+		d[2] = e;
+	}
+};
+
+template<int R, int B>
+struct _rgb888 {
+	enum { bytes = 3, id = R ? PIXFMT_RGB888 : PIXFMT_BGR888 };
+	static inline void store(char *p, unsigned int c) {
+		p[0] = c;
+		p[1] = c >> 8;
+		p[2] = c >> 16;
+	}
+	static inline unsigned int convert(unsigned short c) {
+		return _expand565(c, R, 8, B);
+	}
+	static inline unsigned int rgb(unsigned char r, unsigned char g, unsigned char b) {
+		return r << R | g << 8 | b << B;
+	}
+	static void fill(char *p, int n, unsigned int c) {
+		// 16 pixels of the 3 byte pattern, then whole copies of it
+		char pattern[48];
+		for (int i=0; i<16; i++)
+			store(pattern + i*3, c);
+		for (; n>=16; n-=16, p+=48)
+			memcpy(p, pattern, 48);
+		memcpy(p, pattern, n * 3);
+	}
+	static inline unsigned int fetch(const char *p) {
+		const unsigned char *b = (const unsigned char*)p;
+		return b[0] | b[1] << 8 | b[2] << 16;
+	}
+	static inline unsigned short rgb565(unsigned int c) {
+		return _reduce565(c, R, 8, B);
+	}
+	static inline void rgb24(unsigned int c, unsigned char *d) {
+		d[0] = c >> R;
+		d[1] = c >> 8;
+		d[2] = c >> B;
+	}
+};
+
+template<int R, int B>
+struct _xrgb8888 {
+	enum { bytes = 4, id = R ? PIXFMT_XRGB8888 : PIXFMT_XBGR8888 };
+	static inline void store(char *p, unsigned int c) {
+		*((unsigned int*)p) = c;
+	}
+	static inline unsigned int convert(unsigned short c) {
+		return _expand565(c, R, 8, B);
+	}
+	static inline unsigned int rgb(unsigned char r, unsigned char g, unsigned char b) {
+		return r << R | g << 8 | b << B;
+	}
+	static inline void fill(char *p, int n, unsigned int c) {
+		fill32((unsigned int*)p, n, c);
+	}
+	static inline unsigned int fetch(const char *p) {
+		return *((const unsigned int*)p);
+	}
+	static inline unsigned short rgb565(unsigned int c) {
+		return _reduce565(c, R, 8, B);
+	}
+	static inline void rgb24(unsigned int c, unsigned char *d) {
+		d[0] = c >> R;
+		d[1] = c >> 8;
+		d[2] = c >> B;
+	}
+};
+
+// 8 bit pixels index a fixed RGB332 palette loaded by init()
+struct _indexed8 {
+	enum { bytes = 1, id = PIXFMT_INDEXED8 };
+	static inline void store(char *p, unsigned int c) {
+		*p = c;
+	}
+	static inline unsigned int convert(unsigned short c) {
+		return ((c >> 13) << 5) | (((c >> 8) & 7) << 2) | ((c >> 3) & 3);
+	}
+	static inline unsigned int rgb(unsigned char r, unsigned char g, unsigned char b) {
+		return (r & 0xE0) | ((g >> 3) & 0x1C) | (b >> 6);
+	}
+	static inline void fill(char *p, int n, unsigned int c) {
+		memset(p, c, n);
+	}
+	static inline unsigned int fetch(const char *p) {
+		return *((const unsigned char*)p);
+	}
+	static inline unsigned short rgb565(unsigned int c) {
+		return ((c >> 5) * 31 / 7) << 11 | (((c >> 2) & 7) * 63 / 7) << 5 | (c & 3) * 31 / 3;
+	}
+	static inline void rgb24(unsigned int c, unsigned char *d) {
+		d[0] = (c >> 5) * 255 / 7;
+		d[1] = ((c >> 2) & 7) * 255 / 7;
+		d[2] = (c & 3) * 255 / 3;
+	}
+};
+
+template<class F>
+static void _rasterPixel(char *p, unsigned int c) {
+	F::store(p, c);
+}
+
+template<class F>
+static void _rasterFill(char *p, int n, unsigned int c) {
+	F::fill(p, n, c);
+}
+
+template<class F>
+static void _rasterVSpan(char *p, int n, int stride, unsigned int c) {
+	for (int i=0; i<n; i++, p+=stride)
+		F::store(p, c);
+}
+
+// Bresenham walk starting with error t, mofs and nofs are the byte
+// steps along the major and minor axis.
+template<class F>
+static void _rasterLine(char *p, int n, int mofs, int nofs, int t, int nd, 
+int md, unsigned int c) {
+	for (int i=0; i<n; i++) {
+		F::store(p, c);
+		p += mofs;
+		t += nd;
+		if (t >= 0) {
+			p += nofs;
+			t -= md;
+		}
+	}
+}
+
+template<class F>
+static void _rasterGlyph(char *line, int stride, const unsigned char *bits, 
+int bpr, int rows, int col1, int col2, unsigned int fg, unsigned int bg, 
+bool transparent) {
+	for (int row=0; row<rows; row++, bits+=bpr, line+=stride) {
+		char *p = line;
+		if (!transparent) {
+			for (int col=col1; col<=col2; col++, p+=F::bytes)
+				F::store(p, (bits[col>>3] & (0x80>>(col&7))) ? fg : bg);
+		} else {
+			for (int col=col1; col<=col2; col++, p+=F::bytes)
+				if (bits[col>>3] & (0x80>>(col&7)))
+					F::store(p, fg);
+		}
+	}
+}
+
+// Rows of a compiled glyph, whose row r has the (start, length) pairs
+// from runs[rows[r]] up to runs[rows[r + 1]].
+template<class F>
+static void _rasterRuns(char *line, int stride, const unsigned short *rows, 
+const unsigned char *runs, int nrows, int col1, int col2, unsigned int fg, 
+unsigned int bg, bool transparent) {
+	for (int row=0; row<nrows; row++, line+=stride) {
+		int x = col1;
+		for (int i=rows[row]; i<rows[row + 1]; i+=2) {
+			int r1 = runs[i], r2 = runs[i] + runs[i + 1] - 1;
+			if (r2<x)
+				continue;
+			if (r1>col2)
+				break;
+			if (r1<x)
+				r1 = x;
+			if (r2>col2)
+				r2 = col2;
+			if (!transparent)
+				for (; x<r1; x++)
+					F::store(line + (x - col1) * F::bytes, bg);
+			for (x=r1; x<=r2; x++)
+				F::store(line + (x - col1) * F::bytes, fg);
+		}
+		if (!transparent)
+			for (; x<=col2; x++)
+				F::store(line + (x - col1) * F::bytes, bg);
+	}
+}
+
+template<class F>
+static void _rasterBitmap(char *line, int stride, const unsigned short *src, 
+int sstride, int w, int h) {
+	for (int row=0; row<h; row++, src+=sstride, line+=stride) {
+		char *p = line;
+		for (int col=0; col<w; col++, p+=F::bytes)
+			F::store(p, F::convert(src[col]));
+	}
+}
+
+template<>
+void _rasterBitmap<_rgb565>(char *line, int stride, const unsigned short *src, 
+int sstride, int w, int h) {
+	for (int row=0; row<h; row++, src+=sstride, line+=stride)
+		memcpy(line, src, w * 2);
+}
+
+// Bitmap rows skipping the pixels equal to key.
+template<class F>
+static void _rasterBitmapKey(char *line, int stride, const unsigned short *src, 
+int sstride, int w, int h, unsigned short key) {
+	for (int row=0; row<h; row++, src+=sstride, line+=stride) {
+		char *p = line;
+		for (int col=0; col<w; col++, p+=F::bytes)
+			if (src[col]!=key)
+				F::store(p, F::convert(src[col]));
+	}
+}
+
+template<>
+void _rasterBitmapKey<_rgb565>(char *line, int stride, const unsigned short *src, 
+int sstride, int w, int h, unsigned short key) {
+	for (int row=0; row<h; row++, src+=sstride, line+=stride)
+		key16((unsigned short*)line, src, w, key);
+}
+
+// Rows of native pixels of the same format, skipping the native key.
+template<class F>
+static void _rasterCopyKey(char *line, int stride, const char *src, int sstride, 
+int w, int h, unsigned int key) {
+	for (int row=0; row<h; row++, src+=sstride, line+=stride) {
+		char *p = line;
+		const char *q = src;
+		for (int col=0; col<w; col++, p+=F::bytes, q+=F::bytes)
+			if (F::fetch(q)!=key)
+				F::store(p, F::fetch(q));
+	}
+}
+
+template<>
+void _rasterCopyKey<_rgb565>(char *line, int stride, const char *src, int sstride, 
+int w, int h, unsigned int key) {
+	for (int row=0; row<h; row++, src+=sstride, line+=stride)
+		key16((unsigned short*)line, (const unsigned short*)src, w, key);
+}
+
+template<>
+void _rasterCopyKey<_xrgb8888<16, 0> >(char *line, int stride, const char *src, 
+int sstride, int w, int h, unsigned int key) {
+	for (int row=0; row<h; row++, src+=sstride, line+=stride)
+		key32((unsigned int*)line, (const unsigned int*)src, w, key);
+}
+
+template<>
+void _rasterCopyKey<_xrgb8888<0, 16> >(char *line, int stride, const char *src, 
+int sstride, int w, int h, unsigned int key) {
+	for (int row=0; row<h; row++, src+=sstride, line+=stride)
+		key32((unsigned int*)line, (const unsigned int*)src, w, key);
+}
+
+// Blends n pixels towards the RGB565 src, or the native color c when
+// src is NULL, see _blend_scalar.
+static inline unsigned int _mix8888(unsigned int a, unsigned int b, int w) {
+	unsigned int c = 0;
+	for (int sh=0; sh<32; sh+=8) {
+		int x = (a >> sh) & 0xFF, y = (b >> sh) & 0xFF;
+		c |= (unsigned int)(x + (((y - x) * w) >> 8)) << sh;
+	}
+	return c;
+}
+
+template<class F>
+static void _rasterBlend(char *p, int n, const unsigned short *src, unsigned int c, 
+const unsigned char *mask, int alpha) {
+	for (int i=0; i<n; i++, p+=F::bytes) {
+		int w = mask ? _weight(mask[i], alpha) : alpha;
+		if (w)
+			F::store(p, _mix8888(F::fetch(p), src ? F::convert(src[i]) : c, w));
+	}
+}
+
+template<>
+void _rasterBlend<_rgb565>(char *p, int n, const unsigned short *src, unsigned int c, 
+const unsigned char *mask, int alpha) {
+	blend16((unsigned short*)p, src, n, c, mask, alpha);
+}
+
+// palette indices are blended as RGB565
+template<>
+void _rasterBlend<_indexed8>(char *p, int n, const unsigned short *src, unsigned int c, 
+const unsigned char *mask, int alpha) {
+	unsigned short c565 = _indexed8::rgb565(c);
+	for (int i=0; i<n; i++, p++) {
+		int w = mask ? _weight(mask[i], alpha) : alpha;
+		if (w)
+			*p = _indexed8::convert(_mix565(_indexed8::rgb565(*(unsigned char*)p), 
+				src ? src[i] : c565, w));
+	}
+}
+
+template<class F>
+static unsigned short _rasterLoad(const char *p) {
+	return F::rgb565(F::fetch(p));
+}
+
+// n pixels as RGB byte triplets, for captures.
+template<class F>
+static void _rasterUnpack(const char *p, int n, unsigned char *rgb) {
+	for (int i=0; i<n; i++, p+=F::bytes, rgb+=3)
+		F::rgb24(F::fetch(p), rgb);
+}
+
+template<class F>
+static unsigned int _rasterConvert(unsigned short c) {
+	return F::convert(c);
+}
+
+template<class F>
+static unsigned int _rasterRGB(unsigned char r, unsigned char g, unsigned char b) {
+	return F::rgb(r, g, b);
+}
+
+struct _raster_ops {
+	unsigned char format;
+	unsigned char bytes;
+	unsigned int (*convert)(unsigned short c);
+	unsigned int (*rgb)(unsigned char r, unsigned char g, unsigned char b);
+	void (*pixel)(char *p, unsigned int c);
+	void (*fill)(char *p, int n, unsigned int c);
+	void (*vspan)(char *p, int n, int stride, unsigned int c);
+	void (*line)(char *p, int n, int mofs, int nofs, int t, int nd, int md, unsigned int c);
+	void (*glyph)(char *line, int stride, const unsigned char *bits, int bpr, 
+		int rows, int col1, int col2, unsigned int fg, unsigned int bg, bool transparent);
+	void (*runs)(char *line, int stride, const unsigned short *rows, const unsigned char *runs, 
+		int nrows, int col1, int col2, unsigned int fg, unsigned int bg, bool transparent);
+	void (*bitmap)(char *line, int stride, const unsigned short *src, int sstride, int w, int h);
+	void (*bitmapKey)(char *line, int stride, const unsigned short *src, int sstride, 
+		int w, int h, unsigned short key);
+	void (*copyKey)(char *line, int stride, const char *src, int sstride, int w, int h, 
+		unsigned int key);
+	unsigned short (*load)(const char *p);
+	void (*blend)(char *p, int n, const unsigned short *src, unsigned int c, 
+		const unsigned char *mask, int alpha);
+	void (*unpack)(const char *p, int n, unsigned char *rgb);
+};
+
+template<class F>
+struct _raster {
+	static const _raster_ops ops;
+};
+
+template<class F>
+const _raster_ops _raster<F>::ops = {
+	F::id, F::bytes, _rasterConvert<F>, _rasterRGB<F>, _rasterPixel<F>, _rasterFill<F>, 
+	_rasterVSpan<F>, _rasterLine<F>, _rasterGlyph<F>, _rasterRuns<F>, _rasterBitmap<F>, 
+	_rasterBitmapKey<F>, _rasterCopyKey<F>, _rasterLoad<F>, _rasterBlend<F>, 
+	_rasterUnpack<F>
+};
+
+static const _raster_ops* _pickRaster(unsigned char format) {
+	switch (format) {
+	case PIXFMT_INDEXED8:
+		return &_raster<_indexed8>::ops;
+	case PIXFMT_RGB565:
+		return &_raster<_rgb565>::ops;
+	case PIXFMT_BGR888:
+		return &_raster<_rgb888<0, 16> >::ops;
+	case PIXFMT_RGB888:
+		return &_raster<_rgb888<16, 0> >::ops;
+	case PIXFMT_XBGR8888:
+		return &_raster<_xrgb8888<0, 16> >::ops;
+	case PIXFMT_XRGB8888:
+		return &_raster<_xrgb8888<16, 0> >::ops;
+	}
+	return NULL;
+}
+
+// Pixel format of the layout reported by the driver, 255 if unknown.
+static unsigned char _deviceFormat(const struct fb_var_screeninfo &v) {
+	switch (v.bits_per_pixel) {
+	case 8:
+		return PIXFMT_INDEXED8;
+	case 16:
+		return PIXFMT_RGB565;
+	case 24:
+		return v.red.offset==0 ? PIXFMT_BGR888 : PIXFMT_RGB888;
+	case 32:
+		return v.red.offset==0 ? PIXFMT_XBGR8888 : PIXFMT_XRGB8888;
+	}
+	return 255;
+}
+
+//*********************************
+// ROTATION
+//*********************************
+// Rotated glyphs and bitmaps are drawn by inverse mapping: every 
+// destination pixel of the rotated box is mapped back to the source 
+// with 16.16 fixed point steps. Rows are trimmed to the pixels whose
+// nearest source pixel lies inside the source, so inner loops have no
+// bounds checks and the output has no holes.
+
+// sin of whole degrees in 16.16, 0/90/180/270 are exact
+static int sin_table[360];
+
+static bool _build_sin() {
+	for (int i=0; i<360; i++)
+		sin_table[i] = lround(sin(i * M_PI / 180) * 65536);
+	return true;
+}
+
+static bool sin_built = _build_sin();
+
+static inline long long _floordiv(long long a, long long b) {
+	return a>=0 ? a / b : -((-a + b - 1) / b);
+}
+
+struct _affine {
+	int ox, oy;
+	int c, s;
+	long long ulo, uhi, vlo, vhi;
+	int x1, y1, x2, y2;
+};
+
+// Source box (u1,v1)-(u2,v2) rotated by deg around the screen point
+// (ox,oy), source pixel (u,v) lands on ox + u*cos - v*sin, 
+// oy + v*cos + u*sin. x1..y2 is the destination box.
+static void _affineSetup(_affine &a, int ox, int oy, int u1, int v1, 
+int u2, int v2, unsigned short deg) {
+	deg %= 360;
+	a.ox = ox;
+	a.oy = oy;
+	a.s = sin_table[deg];
+	a.c = sin_table[(deg + 90) % 360];
+	// a destination pixel samples source pixel round(U), accepted
+	// values of U and V are [lo, hi)
+	a.ulo = (long long)u1 * 65536 - 0x8000;
+	a.uhi = (long long)(u2 + 1) * 65536 - 0x8000;
+	a.vlo = (long long)v1 * 65536 - 0x8000;
+	a.vhi = (long long)(v2 + 1) * 65536 - 0x8000;
+
+	long long us[4] = { a.ulo, a.uhi, a.ulo, a.uhi };
+	long long vs[4] = { a.vlo, a.vlo, a.vhi, a.vhi };
+	for (int i=0; i<4; i++) {
+		int px = ox + ((us[i]*a.c - vs[i]*a.s) >> 32);
+		int py = oy + ((vs[i]*a.c + us[i]*a.s) >> 32);
+		if (i==0 || px<a.x1) a.x1 = px;
+		if (i==0 || px>a.x2) a.x2 = px;
+		if (i==0 || py<a.y1) a.y1 = py;
+		if (i==0 || py>a.y2) a.y2 = py;
+	}
+	a.x1--; a.y1--;
+	a.x2++; a.y2++;
+}
+
+// Narrows [k1,k2] to the k with lo <= p + k*d < hi.
+static void _affineRange(long long p, long long d, long long lo, long long hi, 
+int &k1, int &k2) {
+	long long a, b;
+	if (d==0) {
+		if (p<lo || p>=hi)
+			k2 = k1 - 1;
+		return;
+	}
+	if (d>0) {
+		a = -_floordiv(p - lo, d);
+		b = -_floordiv(p - hi, d) - 1;
+	} else {
+		a = _floordiv(p - hi, -d) + 1;
+		b = _floordiv(p - lo, -d);
+	}
+	if (a>k1) k1 = a;
+	if (b<k2) k2 = b;
+}
+
+// Span of row y between columns x1 and x2 that maps inside the source,
+// with the 16.16 source position of its first pixel. false if empty.
+static bool _affineRow(const _affine &a, int y, int &x1, int &x2, int &u, int &v) {
+	long long dx = x1 - a.ox, dy = y - a.oy;
+	long long u0 = dx*a.c + dy*a.s, v0 = dy*a.c - dx*a.s;
+	int k1 = 0, k2 = x2 - x1;
+
+	_affineRange(u0, a.c, a.ulo, a.uhi, k1, k2);
+	_affineRange(v0, -a.s, a.vlo, a.vhi, k1, k2);
+	if (k1>k2)
+		return false;
+	u = u0 + (long long)k1*a.c;
+	v = v0 - (long long)k1*a.s;
+	x2 = x1 + k2;
+	x1 += k1;
+	return true;
+}
+
+//*********************************
+// ANTI-ALIASING
+//*********************************
+// Anti-aliased outlines cover the two pixels nearest the exact curve 
+// at every step, split by the fractional distance in 8 bits, and blend
+// them as one byte masks. All math is integer.
+
+static unsigned long long _isqrt(unsigned long long n) {
+	unsigned long long r = 0, bit = 1ULL << 62;
+	while (bit>n)
+		bit >>= 2;
+	for (; bit; bit>>=2) {
+		if (n>=r + bit) {
+			n -= r + bit;
+			r = (r >> 1) + bit;
+		} else
+			r >>= 1;
+	}
+	return r;
+}
+
+// Directions of an arc from start clockwise over span degrees, in 16.16.
+struct _arc {
+	bool full;
+	int span;
+	long long sx, sy, ex, ey;
+};
+
+static void _arcSetup(_arc &a, int start, int end) {
+	start %= 360;
+	a.span = end - start;
+	while (a.span<0)
+		a.span += 360;
+	a.full = end - start >= 360;
+	a.sx = sin_table[(start + 90) % 360];
+	a.sy = sin_table[start];
+	a.ex = sin_table[(start + a.span + 90) % 360];
+	a.ey = sin_table[(start + a.span) % 360];
+}
+
+// True when the direction (dx,dy) from the centre lies on the arc.
+static bool _onArc(const _arc &a, int dx, int dy) {
+	if (a.full)
+		return true;
+	if (a.span==0)
+		return false;
+	long long sp = a.sx*dy - a.sy*dx, pe = dx*a.ey - dy*a.ex;
+	if (a.span<=180)
+		return sp>=0 && pe>=0;
+	long long ep = a.ex*dy - a.ey*dx, ps = dx*a.sy - dy*a.sx;
+	return !(ep>0 && ps>0);
+}
+
+//*********************************
+// POLYGONS
+//*********************************
+// Filled shapes are converted a row at a time into spans for the fill
+// kernel. A pixel is filled when its centre is inside the shape, on a
+// left or top edge counts as inside and on a right or bottom edge as 
+// outside, so shapes sharing an edge never fill a pixel twice.
+
+// An edge of a polygon between rows y1 and y2, y2 excluded. x is where
+// it crosses the current row, xi + num/den with 0 <= num < den, and 
+// moves by q + r/den every row. dir is 1 downwards, -1 upwards.
+struct _edge {
+	int y1, y2;
+	int x0, y0;
+	int xi, num, den;
+	int q, r;
+	int dir;
+};
+
+#define MAX_STACK_EDGES 32
+
+// Rows of a quarter ellipse from its middle row out, x is the half
+// width of row y: the largest x with x*x*ry*ry + y*y*rx*rx <= rx*rx*ry*ry.
+// err keeps the difference of both sides, so every step is exact and 
+// the walk costs one step per row and column of the outline.
+struct _quarter {
+	long long a2, b2, err;
+	int x, y, ry;
+};
+
+static void _quarterStart(_quarter &q, int rx, int ry) {
+	q.a2 = (long long)rx * rx;
+	q.b2 = (long long)ry * ry;
+	q.err = 0;
+	q.x = rx;
+	q.y = 0;
+	q.ry = ry;
+}
+
+// Moves to the next row out, false past the last.
+static bool _quarterNext(_quarter &q) {
+	if (q.y>=q.ry)
+		return false;
+	q.err -= (2LL * q.y + 1) * q.a2;
+	q.y++;
+	while (q.err<0) {
+		q.err += (2LL * q.x - 1) * q.b2;
+		q.x--;
+	}
+	return true;
+}
+
+static int _edgeOrder(const void *a, const void *b) {
+	return ((const _edge*)a)->y1 - ((const _edge*)b)->y1;
+}
+
+// Places an edge on row y.
+static void _edgeStart(_edge *e, int y) {
+	long long t = (long long)(y - e->y0) * (e->q * e->den + e->r);
+	long long i = _floordiv(t, e->den);
+	e->xi = e->x0 + i;
+	e->num = t - i * e->den;
+}
+
+static inline void _edgeStep(_edge *e) {
+	e->xi += e->q;
+	e->num += e->r;
+	if (e->num>=e->den) {
+		e->xi++;
+		e->num -= e->den;
+	}
+}
+
+// First pixel column right of the crossing.
+static inline int _edgeX(const _edge *e) {
+	return e->xi + (e->num>0);
+}
+
+// True when the direction (dx,dy) lies within 180 degrees clockwise of
+// (ux,uy), (ux,uy) included, its opposite and the centre excluded.
+static inline bool _inHalf(long long ux, long long uy, long long dx, long long dy) {
+	long long c = ux*dy - uy*dx;
+	return c>0 || (c==0 && ux*dx + uy*dy>0);
+}
+
+// The columns [lo,hi] of row dy inside that half-plane, a half line.
+static void _halfRow(long long ux, long long uy, int dy, int &lo, int &hi) {
+	lo = -0x40000000;
+	hi = 0x3FFFFFFF;
+	if (uy==0) {
+		if (dy==0 && ux>0)
+			lo = 1;
+		else if (dy==0)
+			hi = -1;
+		else if (ux*dy<0)
+			hi = lo - 1;
+		return;
+	}
+	// the estimate is off by a column at most where the sides meet
+	long long m = uy>0 ? _floordiv(ux*dy, uy) : _floordiv(-ux*dy, -uy);
+	if (uy>0) {
+		while (!_inHalf(ux, uy, m, dy)) m--;
+		while (_inHalf(ux, uy, m + 1, dy)) m++;
+		hi = m;
+	} else {
+		while (!_inHalf(ux, uy, m, dy)) m++;
+		while (_inHalf(ux, uy, m - 1, dy)) m--;
+		lo = m;
+	}
+}
+
+// The other side of a half line.
+static void _notRow(int &lo, int &hi) {
+	if (lo>hi) {
+		lo = -0x40000000;
+		hi = 0x3FFFFFFF;
+	} else if (lo==-0x40000000 && hi==0x3FFFFFFF)
+		hi = lo - 1;
+	else if (lo==-0x40000000) {
+		lo = hi + 1;
+		hi = 0x3FFFFFFF;
+	} else {
+		hi = lo - 1;
+		lo = -0x40000000;
+	}
+}
+
+//*********************************
+// DISPLAY LISTS
+//*********************************
+// Commands use the STAT_ ids of the recorded method as op codes.
+
+#define CMD_TRANSPARENT 1
+#define CMD_BILINEAR 2
+
+static void _args(_command *c, int a0, int a1=0, int a2=0, int a3=0, int a4=0, 
+int a5=0) {
+	if (!c)
+		return;
+	c->a[0] = a0;
+	c->a[1] = a1;
+	c->a[2] = a2;
+	c->a[3] = a3;
+	c->a[4] = a4;
+	c->a[5] = a5;
+}
+
+static inline bool _overlap(const _command &a, const _command &b) {
+	return a.bx1<=b.bx2 && b.bx1<=a.bx2 && a.by1<=b.by2 && b.by1<=a.by2;
+}
+
+// Whether two commands draw with the same state, all of it so a field
+// added later keeps them apart.
+static inline bool _sameState(const _command &a, const _command &b) {
+	return a.color==b.color && a.back==b.back && a.native==b.native && 
+		a.native_back==b.native_back && a.alpha==b.alpha && 
+		a.flags==b.flags && a.key==b.key;
+}
+
+// Whether c copies from display d, which reads pixels outside its box.
+static inline bool _copiesFrom(const _command &c, const void *d) {
+	return c.op==STAT_COPYBITMAP && c.data==d;
+}
+
+RTFTList::RTFTList() {
+	cmds = NULL;
+	count = 0;
+	size = 0;
+}
+
+RTFTList::~RTFTList() {
+	free(cmds);
+}
+
+void RTFTList::clear() {
+	count = 0;
+}
+
+int RTFTList::getCount() {
+	return count;
+}
+
+//*********************************
+// INSTRUMENTATION
+//*********************************
+// Built with -DRTFT_STATS every public drawing method counts its calls,
+// the pixels it touched and the time spent. Counts are inclusive: the
+// printChar calls of print count for both.
+
+#ifdef RTFT_STATS
+static const char *stat_names[STAT_COUNT] = {
+	"drawRect", "drawRoundRect", "fillRect", "fillRoundRect", "drawCircle", 
+	"fillCircle", "fillScr", "drawPixel", "drawLine", "drawHLine", "drawVLine", 
+	"printChar", "rotateChar", "print", "printNumI", "printNumF", "drawBitmap", 
+	"rotateBitmap", "copyBitmap", "present", "fillMask", "drawBitmapMask", 
+	"drawLineAA", "drawArcAA", "fillTriangle", "fillPolygon", "fillPie", "fillArc", 
+	"drawEllipse", "fillEllipse", "printBox"
+};
+struct _probe {
+	RTFT *t;
+	unsigned char id;
+	long long start;
+	unsigned long long pixels;
+
+	_probe(RTFT *rt, unsigned char i) : t(rt), id(i), start(RTFT::_clock()), 
+		pixels(rt->stat_pixels) {}
+	~_probe() {
+		_prim_stats *st = &t->prim_stats[id];
+		unsigned long long n = t->stat_pixels - pixels;
+		st->calls++;
+		st->pixels += n;
+		st->bytes += n * t->bypp;
+		st->ns += RTFT::_clock() - start;
+	}
+};
+
+#define STAT_PROBE(id) _probe stat_probe(this, id)
+#define STAT_PIXELS(n) stat_pixels += (n)
+#else
+#define STAT_PROBE(id)
+#define STAT_PIXELS(n)
+#endif
+
+// Writes a native color, blended at the current alpha.
+inline void RTFT::_store(char *p, unsigned int color) {
+	if (alpha_w<256)
+		ops->blend(p, 1, NULL, color, NULL, alpha_w);
+	else
+		ops->pixel(p, color);
+}
+
+unsigned char RTFT::init(unsigned short int x, unsigned short int y, 
+unsigned char npages, bool shadow) { 
+	return initDevice("/dev/fb0", x, y, npages, shadow);
+}
+
+void RTFT::_initState() {
+    current_color = 0xFF;
+    current_back_color = 0;
+    _transparent = true;
+    damage_count = 0;
+    frame_ns = 0;
+    frame_count = 0;
+    missed_frames = 0;
+    vsync = false;
+    vsync_state = 0;
+    frame_end = _clock();
+    frame_deadline = frame_end;
+    for (int i=0; i<GLYPH_CACHE; i++) {
+        glyphs[i].pixels = NULL;
+        glyphs[i].size = 0;
+    }
+    rotate_filter = ROTATE_NEAREST;
+    bitmap_key = VGA_TRANSPARENT;
+    alpha = 255;
+    alpha_w = 256;
+    cfont.font = NULL;
+    cfont.spans = NULL;
+    cfont.prop = NULL;
+    glyph_count = 0;
+    glyph_tick = 0;
+    glyph_hits = 0;
+    glyph_misses = 0;
+    for (int i=0; i<TEXT_CACHE; i++) {
+        texts[i].text = NULL;
+        texts[i].lines = NULL;
+        texts[i].pixels = NULL;
+    }
+    text_count = 0;
+    text_tick = 0;
+    recording = NULL;
+    pool = NULL;
+    capture = NULL;
+    server = NULL;
+#ifdef RTFT_STATS
+    stat_every = 0;
+    stat_fd = -1;
+    stat_file = NULL;
+    resetPrimitiveStats();
+#endif
+//+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++    
+    fbp = NULL;
+    wbp = NULL;
+    ops = NULL;
+    backbuf = NULL;
+    page_shadow = NULL;
+    fbfd = -1;
+    screensize = 0;
+    pagesize = 0;
+    pages = 1;
+    write_page = 0;
+    display_page = 0;
+}
+
+unsigned char RTFT::initDevice(const char *device, unsigned short int x, 
+unsigned short int y, unsigned char npages, bool shadow) { 
+//+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+	
+	if (x%32) x = x + 32 - (x%32);
+	if (y%16) y = y + 16 - (y%16);
+	if (npages<1) npages = 1;
+	if (npages>MAX_PAGES) npages = MAX_PAGES;
+	// a shadow buffer replaces the video memory pages
+	if (shadow) npages = 2;
+
+	_initState();
+	surface.type = SURFACE_FBDEV;
+
+    // Open the file for reading and writing
+    fbfd = open(device, O_RDWR);
+    if (fbfd<0) {
+      fprintf(stderr,"RTFT Error 01: cannot open framebuffer device.\n");
+      return 1;
+    }
+//    printf("The framebuffer device was opened successfully.\n");
+
+    // Get variable screen information
+    if (ioctl(fbfd, FBIOGET_VSCREENINFO, &vinfo)) {
+      fprintf(stderr,"RTFT Error 02: reading variable information.\n");
+      return 2;
+    }
+//    printf("Original %dx%d, %dbpp\n", vinfo.xres, vinfo.yres, 
+//       vinfo.bits_per_pixel );
+
+    // Store for reset (copy vinfo to vinfo_orig)
+    memcpy(&orig_vinfo, &vinfo, sizeof(struct fb_var_screeninfo));
+    
+    // Change variable info
+    // the pixel format is kept as the driver has it, use: 'fbset -depth x'
+    // to test different bpps
+    // every page is stacked below the previous one in the virtual screen
+	vinfo.xres = x;
+	vinfo.yres = y;
+	vinfo.xres_virtual = vinfo.xres;
+	vinfo.yres_virtual = vinfo.yres * (shadow ? 1 : npages);
+	vinfo.xoffset = 0;
+	vinfo.yoffset = 0;
+
+	if (ioctl(fbfd, FBIOPUT_VSCREENINFO, &vinfo)) {
+		// some drivers refuse a taller virtual screen, retry with one page
+		vinfo.yres_virtual = vinfo.yres;
+		if ((npages==1) || ioctl(fbfd, FBIOPUT_VSCREENINFO, &vinfo)) {
+			fprintf(stderr,"RTFT Error 03: setting variable information.\n");
+			return 3;
+		}
+	}
+	
+	if (ioctl(fbfd, FBIOGET_VSCREENINFO, &vinfo)) {
+      fprintf(stderr,"RTFT Error 04: reading variable information.\n");
+      return 4;
+    }
+//    printf("New %dx%d, %dbpp\n", vinfo.xres, vinfo.yres, 
+//       vinfo.bits_per_pixel );
+
+    // Get fixed screen information
+    if (ioctl(fbfd, FBIOGET_FSCREENINFO, &finfo)) {
+      fprintf(stderr,"RTFT Error 05: reading fixed information.\n");
+      return 5;
+    }
+
+    if (!_setSurface(vinfo.xres, vinfo.yres, _deviceFormat(vinfo), finfo.line_length)) {
+      fprintf(stderr,"RTFT Error 10: unsupported pixel format.\n");
+      return 10;
+    }
+    if (vinfo.bits_per_pixel==8)
+        _loadPalette();
+
+    // map fb to user mem 
+    pages = npages;
+    if (shadow || vinfo.yres_virtual < vinfo.yres * npages) {
+        // no room for the pages in video memory, draw into a heap back
+        // buffer and copy it to the screen on present()
+        pages = 1;
+    }
+    screensize = pagesize * pages;
+    
+    fbp = (char*)mmap(0, 
+              screensize, 
+              PROT_READ | PROT_WRITE, 
+              MAP_SHARED, 
+              fbfd, 
+              0);
+
+    if (fbp == MAP_FAILED) {
+        fbp = NULL;
+        fprintf(stderr,"RTFT Error 06: Failed to mmap.\n");
+        return 6;
+    }
+
+    return _initPages(npages);
+}
+
+// Draws into heap memory, for rendering off-screen. Every page is
+// kept in memory, getPixels() returns the one last presented.
+unsigned char RTFT::initMemory(unsigned short int x, unsigned short int y, 
+unsigned char format, unsigned char npages, bool shadow) {
+	if (npages<1) npages = 1;
+	if (npages>MAX_PAGES) npages = MAX_PAGES;
+	if (shadow) npages = 2;
+
+	_initState();
+	surface.type = SURFACE_MEMORY;
+	vsync_state = -1;
+	if (!_setSurface(x, y, format, 0)) {
+		fprintf(stderr,"RTFT Error 10: unsupported pixel format.\n");
+		return 10;
+	}
+
+	pages = shadow ? 1 : npages;
+	screensize = pagesize * pages;
+	fbp = (char*)malloc(screensize);
+	if (!fbp) {
+		fprintf(stderr,"RTFT Error 12: cannot allocate surface.\n");
+		return 12;
+	}
+
+	return _initPages(npages);
+}
+
+// Draws into a file mapped in shared memory, so another process can
+// read the frames. The file holds one page, a shadow buffer lets only
+// whole frames reach it.
+unsigned char RTFT::initFile(const char *path, unsigned short int x, 
+unsigned short int y, unsigned char format, bool shadow) {
+	_initState();
+	surface.type = SURFACE_FILE;
+	vsync_state = -1;
+	if (!_setSurface(x, y, format, 0)) {
+		fprintf(stderr,"RTFT Error 10: unsupported pixel format.\n");
+		return 10;
+	}
+
+	fbfd = open(path, O_RDWR | O_CREAT, 0644);
+	if (fbfd<0) {
+		fprintf(stderr,"RTFT Error 13: cannot open surface file.\n");
+		return 13;
+	}
+	if (ftruncate(fbfd, pagesize)) {
+		fprintf(stderr,"RTFT Error 14: cannot resize surface file.\n");
+		return 14;
+	}
+
+	pages = 1;
+	screensize = pagesize;
+	fbp = (char*)mmap(0, screensize, PROT_READ | PROT_WRITE, MAP_SHARED, fbfd, 0);
+	if (fbp == MAP_FAILED) {
+		fbp = NULL;
+		fprintf(stderr,"RTFT Error 06: Failed to mmap.\n");
+		return 6;
+	}
+
+	return _initPages(shadow ? 2 : 1);
+}
+
+// Describes the pixels drawn on, stride 0 packs the rows.
+bool RTFT::_setSurface(int width, int height, unsigned char format, int stride) {
+	ops = _pickRaster(format);
+	if (!ops || width<=0 || height<=0)
+		return false;
+	bypp = ops->bytes;
+	surface.width = width;
+	surface.height = height;
+	surface.stride = stride ? stride : width * bypp;
+	surface.format = format;
+	pagesize = (long int)surface.stride * height;
+	setColor(current_color);
+	setBackColor(current_back_color);
+	return true;
+}
+
+// Clears the pages, with a back buffer when the surface had no room
+// for npages of them.
+unsigned char RTFT::_initPages(unsigned char npages) {
+    // the pages are cleared first, a back buffer takes every write
+    resetClip();
+    for (int i=pages-1; i>=0; i--) {
+        setWritePage(i);
+        clrScr();
+    }
+    if (npages>1 && pages==1) {
+        backbuf = (char*)malloc(pagesize);
+        if (!backbuf) {
+            fprintf(stderr,"RTFT Error 07: cannot allocate back buffer.\n");
+            return 7;
+        }
+        wbp = backbuf;
+        clrScr();
+    }
+    setWritePage(pages>1 ? 1 : 0);
+    damage_count = 0;
+    return 0;
+}
+
+RTFT::~RTFT() {
+	setThreads(1);
+	stopCapture();
+	stopServer();
+	switch (surface.type) {
+	case SURFACE_FBDEV:
+		memcpy(&vinfo, &orig_vinfo, sizeof(struct fb_var_screeninfo));
+		if (fbfd>=0 && ioctl(fbfd, FBIOPUT_VSCREENINFO, &vinfo)) {
+			fprintf(stderr,"RTFT Error 90: setting variable information.\n");
+		}
+		if (fbp)
+			munmap(fbp,screensize);
+		break;
+	case SURFACE_MEMORY:
+		free(fbp);
+		break;
+	case SURFACE_FILE:
+		if (fbp)
+			munmap(fbp,screensize);
+		break;
+	}
+	free(backbuf);
+	clearGlyphCache();
+	clearTextCache();
+	if (fbfd>=0)
+		close(fbfd);
+	setStatsDump(NULL, 0);
+}
+
+void RTFT::drawRect(unsigned short int x1, unsigned short int y1, 
+unsigned short int x2, unsigned short int y2)
+{
+	STAT_PROBE(STAT_DRAWRECT);
+	if (recording) {
+		_args(_record(STAT_DRAWRECT, x1, y1, x2, y2), x1, y1, x2, y2);
+		return;
+	}
+	if (x1>x2) swap(unsigned short int, x1, x2);
+	if (y1>y2) swap(unsigned short int, y1, y2);
+	int sx1 = x1 + clip.ox, sy1 = y1 + clip.oy;
+	int sx2 = x2 + clip.ox, sy2 = y2 + clip.oy;
+
+	// every pixel once, so translucent outlines have even corners
+	_hline(sx1, sy1, sx2-sx1);
+	if (sy2>sy1)
+		_hline(sx1, sy2, sx2-sx1);
+	if (sy2-sy1>1) {
+		_vline(sx1, sy1+1, sy2-sy1-2);
+		if (sx2>sx1)
+			_vline(sx2, sy1+1, sy2-sy1-2);
+	}
+	_addDamage(sx1, sy1, sx2, sy2);
+}
+
+// The UTFT look: corners of radius 2, nothing when the box is too small.
+void RTFT::drawRoundRect(unsigned short int x1, unsigned short int y1, 
+unsigned short int x2, unsigned short int y2)
+{
+	if (abs(x2-x1)>4 && abs(y2-y1)>4)
+		drawRoundRect(x1, y1, x2, y2, 2);
+}
+
+// Corners are quarter circles of radius pixels, at most half the box.
+void RTFT::drawRoundRect(unsigned short int x1, unsigned short int y1, 
+unsigned short int x2, unsigned short int y2, unsigned short int radius)
+{
+	STAT_PROBE(STAT_DRAWROUNDRECT);
+	if (recording) {
+		_args(_record(STAT_DRAWROUNDRECT, x1, y1, x2, y2), x1, y1, x2, y2, radius);
+		return;
+	}
+	if (x1>x2) swap(unsigned short int, x1, x2);
+	if (y1>y2) swap(unsigned short int, y1, y2);
+	int r = radius;
+	if (r>(x2-x1)/2) r = (x2-x1)/2;
+	if (r>(y2-y1)/2) r = (y2-y1)/2;
+	_drawRound(x1 + r + clip.ox, y1 + r + clip.oy, x2 - r + clip.ox, 
+		y2 - r + clip.oy, r, r);
+}
+
+void RTFT::fillRect(unsigned short int x1, unsigned short int y1, 
+unsigned short int x2, unsigned short int y2)
+{
+	STAT_PROBE(STAT_FILLRECT);
+	if (recording) {
+		_args(_record(STAT_FILLRECT, x1, y1, x2, y2), x1, y1, x2, y2);
+		return;
+	}
+	if (x1>x2) swap(unsigned short int, x1, x2);
+	if (y1>y2) swap(unsigned short int, y1, y2);
+	int sx1 = x1 + clip.ox, sy1 = y1 + clip.oy;
+	int sx2 = x2 + clip.ox, sy2 = y2 + clip.oy;
+
+	if (!_clipRect(sx1, sy1, sx2, sy2))
+		return;
+	_addDamage(sx1, sy1, sx2, sy2);
+
+	char *row = wbp + sy1 * surface.stride + sx1 * bypp;
+	STAT_PIXELS((sx2 - sx1 + 1) * (sy2 - sy1 + 1));
+    for (int y = sy1; y <= sy2 ; y++) {
+        if (alpha_w<256)
+            ops->blend(row, sx2 - sx1 + 1, NULL, native_color, NULL, alpha_w);
+        else
+            ops->fill(row, sx2 - sx1 + 1, native_color);
+        row += surface.stride;
+    }
+}
+
+void RTFT::fillRoundRect(unsigned short int x1, unsigned short int y1, 
+unsigned short int x2, unsigned short int y2)
+{
+	if (abs(x2-x1)>4 && abs(y2-y1)>4)
+		fillRoundRect(x1, y1, x2, y2, 2);
+}
+
+void RTFT::fillRoundRect(unsigned short int x1, unsigned short int y1, 
+unsigned short int x2, unsigned short int y2, unsigned short int radius)
+{
+	STAT_PROBE(STAT_FILLROUNDRECT);
+	if (recording) {
+		_args(_record(STAT_FILLROUNDRECT, x1, y1, x2, y2), x1, y1, x2, y2, radius);
+		return;
+	}
+	if (x1>x2) swap(unsigned short int, x1, x2);
+	if (y1>y2) swap(unsigned short int, y1, y2);
+	int r = radius;
+	if (r>(x2-x1)/2) r = (x2-x1)/2;
+	if (r>(y2-y1)/2) r = (y2-y1)/2;
+	_fillRound(x1 + r + clip.ox, y1 + r + clip.oy, x2 - r + clip.ox, 
+		y2 - r + clip.oy, r, r);
+}
+
+void RTFT::drawCircle(unsigned short int x, unsigned short int y, 
+unsigned short int radius)
+{
+	STAT_PROBE(STAT_DRAWCIRCLE);
+	if (recording) {
+		_args(_record(STAT_DRAWCIRCLE, x - radius, y - radius, x + radius, y + radius), 
+			x, y, radius);
+		return;
+	}
+	short int f = 1 - radius;
+	short int ddF_x = 1;
+	short int ddF_y = -2 * radius;
+	short int x1 = 0;
+	short int y1 = radius;
+	int cx = x + clip.ox, cy = y + clip.oy;
+	int bx1 = cx - radius, by1 = cy - radius;
+	int bx2 = cx + radius, by2 = cy + radius;
+
+	if (!_clipRect(bx1, by1, bx2, by2))
+		return;
+	_addDamage(bx1, by1, bx2, by2);
+	// only a circle crossing the clip edge needs per pixel checks
+	void (RTFT::*plot)(int, int) = &RTFT::_pixel;
+	if (bx1==cx-radius && by1==cy-radius && bx2==cx+radius && by2==cy+radius)
+		plot = &RTFT::_rawPixel;
+ 
+    (this->*plot)(cx, cy + radius);
+    if (radius==0)
+        return;
+    (this->*plot)(cx, cy - radius);
+    (this->*plot)(cx + radius, cy);
+    (this->*plot)(cx - radius, cy);
+ 
+	while(x1 < y1) {
+		if(f >= 0) {
+			y1--;
+			ddF_y += 2;
+			f += ddF_y;
+		}
+		x1++;
+		ddF_x += 2;
+		f += ddF_x;    
+		// the octants meet, past it the points were all drawn
+		if (x1>y1)
+			break;
+        (this->*plot)(cx + x1, cy + y1);
+        (this->*plot)(cx - x1, cy + y1);
+        (this->*plot)(cx + x1, cy - y1);
+        (this->*plot)(cx - x1, cy - y1);
+        if (x1==y1)
+            continue;
+        (this->*plot)(cx + y1, cy + x1);
+        (this->*plot)(cx - y1, cy + x1);
+        (this->*plot)(cx + y1, cy - x1);
+        (this->*plot)(cx - y1, cy - x1);
+	}
+
+}
+
+void RTFT::fillCircle(unsigned short int x, unsigned short int y, 
+unsigned short int radius) {
+	STAT_PROBE(STAT_FILLCIRCLE);
+	if (recording) {
+		_args(_record(STAT_FILLCIRCLE, x - radius, y - radius, x + radius, y + radius), 
+			x, y, radius);
+		return;
+	}
+	int cx = x + clip.ox, cy = y + clip.oy;
+	_fillRound(cx, cy, cx, cy, radius, radius);
+}
+
+void RTFT::drawEllipse(unsigned short int x, unsigned short int y, 
+unsigned short int rx, unsigned short int ry) {
+	STAT_PROBE(STAT_DRAWELLIPSE);
+	if (recording) {
+		_args(_record(STAT_DRAWELLIPSE, x - rx, y - ry, x + rx, y + ry), x, y, rx, ry);
+		return;
+	}
+	int cx = x + clip.ox, cy = y + clip.oy;
+	_drawRound(cx, cy, cx, cy, rx, ry);
+}
+
+void RTFT::fillEllipse(unsigned short int x, unsigned short int y, 
+unsigned short int rx, unsigned short int ry) {
+	STAT_PROBE(STAT_FILLELLIPSE);
+	if (recording) {
+		_args(_record(STAT_FILLELLIPSE, x - rx, y - ry, x + rx, y + ry), x, y, rx, ry);
+		return;
+	}
+	int cx = x + clip.ox, cy = y + clip.oy;
+	_fillRound(cx, cy, cx, cy, rx, ry);
+}
+
+// The box x1..x2 by y1..y2, in screen coordinates, grown by a quarter
+// ellipse of rx by ry at every corner: an ellipse when the box is a 
+// point, a round rectangle otherwise. Every row is a single span.
+void RTFT::_fillRound(int x1, int y1, int x2, int y2, int rx, int ry) {
+	int bx1 = x1 - rx, by1 = y1 - ry, bx2 = x2 + rx, by2 = y2 + ry;
+	_quarter q;
+
+	if (!_clipRect(bx1, by1, bx2, by2))
+		return;
+	_addDamage(bx1, by1, bx2, by2);
+	_quarterStart(q, rx, ry);
+	do {
+		_hline(x1 - q.x, y1 - q.y, x2 - x1 + 2 * q.x);
+		if (y2 + q.y!=y1 - q.y)
+			_hline(x1 - q.x, y2 + q.y, x2 - x1 + 2 * q.x);
+	} while (_quarterNext(q));
+	for (int y=y1+1; y<y2; y++)
+		_hline(x1 - rx, y, x2 - x1 + 2 * rx);
+}
+
+// The pixels of _fillRound() next to a pixel outside it. A row of the
+// corners is drawn from its own half width in to just past the half 
+// width of the row further out, at least one pixel.
+void RTFT::_drawRound(int x1, int y1, int x2, int y2, int rx, int ry) {
+	int bx1 = x1 - rx, by1 = y1 - ry, bx2 = x2 + rx, by2 = y2 + ry;
+	_quarter q;
+	bool more = true;
+
+	if (!_clipRect(bx1, by1, bx2, by2))
+		return;
+	_addDamage(bx1, by1, bx2, by2);
+	_quarterStart(q, rx, ry);
+	while (more) {
+		int dy = q.y, w = q.x;
+		more = _quarterNext(q);
+		int in = q.x<w ? q.x + 1 : w;
+		for (int y=y1-dy; ; y=y2+dy) {
+			if (!more || x1 - in>=x2 + in - 1)
+				_hline(x1 - w, y, x2 - x1 + 2 * w);
+			else {
+				_hline(x1 - w, y, w - in);
+				_hline(x2 + in, y, w - in);
+			}
+			if (y==y2 + dy)
+				break;
+		}
+	}
+	if (y2 - y1>1) {
+		_vline(x1 - rx, y1 + 1, y2 - y1 - 2);
+		if (x2 + rx>x1 - rx)
+			_vline(x2 + rx, y1 + 1, y2 - y1 - 2);
+	}
+}
+
+void RTFT::fillTriangle(unsigned short int x1, unsigned short int y1, 
+unsigned short int x2, unsigned short int y2, unsigned short int x3, 
+unsigned short int y3) {
+	STAT_PROBE(STAT_FILLTRIANGLE);
+	_point p[3] = { { (short)x1, (short)y1 }, { (short)x2, (short)y2 }, 
+		{ (short)x3, (short)y3 } };
+	if (recording) {
+		_command *c = _record(STAT_FILLTRIANGLE, x1<x2 ? x1 : x2, y1<y2 ? y1 : y2, 
+			x1>x2 ? x1 : x2, y1>y2 ? y1 : y2);
+		if (!c)
+			return;
+		_args(c, x1, y1, x2, y2, x3, y3);
+		if (x3<c->bx1) c->bx1 = x3;
+		if (y3<c->by1) c->by1 = y3;
+		if (x3>c->bx2) c->bx2 = x3;
+		if (y3>c->by2) c->by2 = y3;
+		return;
+	}
+	_fillPolygon(p, 3, clip.ox, clip.oy, FILL_EVENODD);
+}
+
+// Points are in the coordinates of the viewport. rule decides which
+// parts of a self crossing polygon are inside, convex ones look the
+// same with both.
+void RTFT::fillPolygon(const _point *points, unsigned short int n, unsigned char rule) {
+	STAT_PROBE(STAT_FILLPOLYGON);
+	if (n<3)
+		return;
+	if (recording) {
+		int bx1 = points[0].x, by1 = points[0].y, bx2 = bx1, by2 = by1;
+		for (int i=1; i<n; i++) {
+			if (points[i].x<bx1) bx1 = points[i].x;
+			if (points[i].y<by1) by1 = points[i].y;
+			if (points[i].x>bx2) bx2 = points[i].x;
+			if (points[i].y>by2) by2 = points[i].y;
+		}
+		_command *c = _record(STAT_FILLPOLYGON, bx1, by1, bx2, by2);
+		_args(c, n, rule);
+		if (c)
+			c->data = points;
+		return;
+	}
+	_fillPolygon(points, n, clip.ox, clip.oy, rule);
+}
+
+// Active edge table scan: edges sorted by their first row join the 
+// active list when the scan reaches them and leave it after their last
+// row, the active list is kept sorted by x with an insertion sort, 
+// which only moves edges that crossed.
+void RTFT::_fillPolygon(const _point *points, int n, int ox, int oy, 
+unsigned char rule) {
+	_edge stack_edges[MAX_STACK_EDGES], *stack_active[MAX_STACK_EDGES];
+	_edge *edges = stack_edges, **active = stack_active;
+	int ne = 0, bx1 = 0, by1 = 0, bx2 = -1, by2 = -1;
+
+	if (n>MAX_STACK_EDGES) {
+		edges = (_edge*)malloc(n * (sizeof(_edge) + sizeof(_edge*)));
+		if (!edges) {
+			fprintf(stderr,"RTFT Error 18: cannot allocate polygon edges.\n");
+			return;
+		}
+		active = (_edge**)(edges + n);
+	}
+	for (int i=0; i<n; i++) {
+		int ax = points[i].x + ox, ay = points[i].y + oy;
+		int bx = points[(i + 1) % n].x + ox, by = points[(i + 1) % n].y + oy;
+		if (i==0 || ax<bx1) bx1 = ax;
+		if (i==0 || ay<by1) by1 = ay;
+		if (i==0 || ax>bx2) bx2 = ax;
+		if (i==0 || ay>by2) by2 = ay;
+		// horizontal edges cross no row centre
+		if (ay==by)
+			continue;
+		_edge *e = &edges[ne++];
+		e->dir = 1;
+		if (ay>by) {
+			swap(int, ax, bx);
+			swap(int, ay, by);
+			e->dir = -1;
+		}
+		e->y1 = ay;
+		e->y2 = by;
+		e->x0 = ax;
+		e->y0 = ay;
+		e->den = by - ay;
+		e->q = _floordiv(bx - ax, e->den);
+		e->r = bx - ax - e->q * e->den;
+	}
+
+	int y1 = by1, y2 = by2 - 1;
+	if (_clipRect(bx1, y1, bx2, y2)) {
+		_addDamage(bx1, y1, bx2, y2);
+		qsort(edges, ne, sizeof(_edge), _edgeOrder);
+		int next = 0, na = 0;
+		for (int y=y1; y<=y2; y++) {
+			int k = 0;
+			for (int i=0; i<na; i++)
+				if (active[i]->y2>y)
+					active[k++] = active[i];
+			na = k;
+			for (; next<ne && edges[next].y1<=y; next++)
+				if (edges[next].y2>y) {
+					_edgeStart(&edges[next], y);
+					active[na++] = &edges[next];
+				}
+			for (int i=1; i<na; i++) {
+				_edge *e = active[i];
+				int x = _edgeX(e), j = i;
+				for (; j>0 && _edgeX(active[j-1])>x; j--)
+					active[j] = active[j-1];
+				active[j] = e;
+			}
+
+			if (rule==FILL_NONZERO) {
+				for (int i=0, w=0, x=0; i<na; i++) {
+					if (w==0)
+						x = _edgeX(active[i]);
+					w += active[i]->dir;
+					if (w==0 && _edgeX(active[i])>x)
+						_hline(x, y, _edgeX(active[i]) - 1 - x);
+				}
+			} else {
+				for (int i=0; i+1<na; i+=2) {
+					int x = _edgeX(active[i]), x2 = _edgeX(active[i+1]);
+					if (x2>x)
+						_hline(x, y, x2 - 1 - x);
+				}
+			}
+			for (int i=0; i<na; i++)
+				_edgeStep(active[i]);
+		}
+	}
+	if (edges!=stack_edges)
+		free(edges);
+}
+
+void RTFT::fillPie(unsigned short int x, unsigned short int y, 
+unsigned short int radius, unsigned short int start, unsigned short int end) {
+	STAT_PROBE(STAT_FILLPIE);
+	if (recording) {
+		_args(_record(STAT_FILLPIE, x - radius, y - radius, x + radius, y + radius), 
+			x, y, radius, start, end);
+		return;
+	}
+	_fillArc(x + clip.ox, y + clip.oy, radius, -1, start, end);
+}
+
+// A ring width pixels thick inside radius, from start clockwise to 
+// end in degrees from the 3 o'clock direction, as drawArcAA().
+void RTFT::fillArc(unsigned short int x, unsigned short int y, 
+unsigned short int radius, unsigned short int width, unsigned short int start, 
+unsigned short int end) {
+	STAT_PROBE(STAT_FILLARC);
+	if (recording) {
+		_args(_record(STAT_FILLARC, x - radius, y - radius, x + radius, y + radius), 
+			x, y, radius, width, start, end);
+		return;
+	}
+	_fillArc(x + clip.ox, y + clip.oy, radius, radius - width, start, end);
+}
+
+// Pixels of the disc of fillCircle() outside the disc of radius inner
+// whose direction from the centre is on the arc. The two sides of the
+// arc are half planes, on every row each gives a half line of columns:
+// arcs up to 180 degrees are the columns inside the start side and not
+// inside the end one, longer arcs everything but the columns inside 
+// the end side and not the start one. The centre goes with the 3 
+// o'clock direction, so pies sharing a side never overlap.
+void RTFT::_fillArc(int cx, int cy, int r, int inner, int start, int end) {
+	_arc a;
+	int bx1 = cx - r, by1 = cy - r, bx2 = cx + r, by2 = cy + r;
+
+	_arcSetup(a, start, end);
+	if ((!a.full && a.span==0) || inner>=r || !_clipRect(bx1, by1, bx2, by2))
+		return;
+	_addDamage(bx1, by1, bx2, by2);
+
+	long long r2 = (long long)r * r, i2 = (long long)inner * inner;
+	for (int y=by1; y<=by2; y++) {
+		int dy = y - cy, w = _isqrt(r2 - (long long)dy * dy);
+		// up to two pieces of the ring and two of the arc on a row
+		int ring[4] = { -w, w, 1, 0 }, sect[4] = { -0x40000000, 0x3FFFFFFF, 1, 0 };
+		if (inner>=0 && (long long)dy * dy<=i2) {
+			int wi = _isqrt(i2 - (long long)dy * dy);
+			ring[1] = -wi - 1;
+			ring[2] = wi + 1;
+			ring[3] = w;
+		}
+		if (!a.full) {
+			int s1, s2, e1, e2;
+			_halfRow(a.sx, a.sy, dy, s1, s2);
+			_halfRow(a.ex, a.ey, dy, e1, e2);
+			if (a.span<=180) {
+				_notRow(e1, e2);
+				sect[0] = s1>e1 ? s1 : e1;
+				sect[1] = s2<e2 ? s2 : e2;
+			} else {
+				_notRow(s1, s2);
+				int g1 = s1>e1 ? s1 : e1, g2 = s2<e2 ? s2 : e2;
+				if (g1<=g2) {
+					sect[1] = g1 - 1;
+					sect[2] = g2 + 1;
+					sect[3] = 0x3FFFFFFF;
+				}
+			}
+			if (dy==0 && inner<0) {
+				// the centre is filled like the pixel right of it
+				ring[1] = -1;
+				ring[2] = 1;
+				ring[3] = w;
+				if ((sect[0]<=1 && 1<=sect[1]) || (sect[2]<=1 && 1<=sect[3]))
+					_hline(cx, y, 0);
+			}
+		}
+		for (int i=0; i<4; i+=2)
+			for (int j=0; j<4; j+=2) {
+				int x1 = ring[i]>sect[j] ? ring[i] : sect[j];
+				int x2 = ring[i+1]<sect[j+1] ? ring[i+1] : sect[j+1];
+				if (x1<=x2)
+					_hline(cx + x1, y, x2 - x1);
+			}
+	}
+}
+
+void RTFT::clrScr() {
+	unsigned char a = alpha;
+	setAlpha(255);
+	fillScr(0);
+	setAlpha(a);
+}
+
+void RTFT::fillScr(unsigned char r, unsigned char g, unsigned char b) {
+    unsigned short int color = ((r&248)<<8 | (g&252)<<3 | (b&248)>>3);
+	fillScr(color);
+}
+
+void RTFT::fillScr(unsigned short int color) {
+	STAT_PROBE(STAT_FILLSCR);
+	if (recording) {
+		_args(_record(STAT_FILLSCR, -0x40000000, -0x40000000, 0x3FFFFFFF, 0x3FFFFFFF), 
+			color);
+		return;
+	}
+	unsigned int native = ops->convert(color);
+
+	STAT_PIXELS(surface.width * surface.height);
+	if (alpha_w<256)
+		for (int y=0; y<surface.height; y++)
+			ops->blend(wbp + y * surface.stride, surface.width, NULL, native, NULL, alpha_w);
+	else if (surface.stride==surface.width * bypp)
+		ops->fill(wbp, pagesize / bypp, native);
+	else
+		for (int y=0; y<surface.height; y++)
+			ops->fill(wbp + y * surface.stride, surface.width, native);
+	damage_count = 0;
+	_addDamage(0, 0, surface.width - 1, surface.height - 1);
+}
+
+void RTFT::setColor(unsigned char r, unsigned char g, unsigned char b) {
+    current_color = ((r&248)<<8 | (g&252)<<3 | (b&248)>>3);
+    native_color = ops->rgb(r, g, b);
+}
+
+void RTFT::setColor(unsigned short int color) {
+    current_color = color;
+    native_color = ops->convert(color);
+}
+
+unsigned short int RTFT::getColor() {
+    return current_color;
+}
+
+void RTFT::setBackColor(unsigned char r, unsigned char g, unsigned char b) {
+    current_back_color = ((r&248)<<8 | (g&252)<<3 | (b&248)>>3);
+    native_back_color = ops->rgb(r, g, b);
+}
+
+void RTFT::setBackColor(unsigned short int color) {
+    current_back_color = color;
+    native_back_color = ops->convert(color);
+}
+
+unsigned short int RTFT::getBackColor() {
+    return current_back_color;
+}
+
+/*
+void RTFT::setPixel(word color)
+{
+	LCD_Write_DATA((color>>8),(color&0xFF));	// rrrrrggggggbbbbb
+}
+*/
+
+void RTFT::drawPixel(unsigned short int x, unsigned short int y) {
+	drawPixel(x, y, current_color);
+}
+
+void RTFT::drawPixel(unsigned short int x, unsigned short int y, 
+unsigned short int color) {
+	STAT_PROBE(STAT_DRAWPIXEL);
+	if (recording) {
+		_args(_record(STAT_DRAWPIXEL, x, y, x, y), x, y, color);
+		return;
+	}
+	int sx = x + clip.ox, sy = y + clip.oy;
+
+	if (sx<clip.x1 || sx>clip.x2 || sy<clip.y1 || sy>clip.y2)
+		return;
+	_rawPixel(sx, sy, color==current_color ? native_color : ops->convert(color));
+	_addDamage(sx, sy, sx, sy);
+}
+
+void RTFT::_pixel(int x, int y) {
+	_pixel(x, y, native_color);
+}
+
+void RTFT::_pixel(int x, int y, unsigned int color) {
+	if (x<clip.x1 || x>clip.x2 || y<clip.y1 || y>clip.y2)
+		return;
+	_rawPixel(x, y, color);
+}
+
+void RTFT::_rawPixel(int x, int y) {
+	_rawPixel(x, y, native_color);
+}
+
+void RTFT::_rawPixel(int x, int y, unsigned int color) {
+    // calculate the pixel's byte offset inside the buffer
+    unsigned int pix_offset = x * bypp + y * surface.stride;
+
+    _store(wbp + pix_offset, color);
+    STAT_PIXELS(1);
+}
+
+// Minor axis steps taken by drawLine after k major axis steps.
+static inline long long _minorSteps(long long t0, long long k, int nd, int md) {
+	return t0 + k*nd >= 0 ? (t0 + k*nd) / md + 1 : 0;
+}
+
+void RTFT::drawLine(unsigned short int x1, unsigned short int y1, 
+unsigned short int x2, unsigned short int y2) {
+	STAT_PROBE(STAT_DRAWLINE);
+	if (recording) {
+		_args(_record(STAT_DRAWLINE, x1, y1, x2, y2), x1, y1, x2, y2);
+		return;
+	}
+	int sx1 = x1 + clip.ox, sy1 = y1 + clip.oy;
+	int sx2 = x2 + clip.ox, sy2 = y2 + clip.oy;
+
+	if (sy1==sy2) {
+		_hline(sx1, sy1, sx2-sx1);
+		_addDamage(sx1, sy1, sx2, sy2);
+		return;
+	}
+	if (sx1==sx2) {
+		_vline(sx1, sy1, sy2-sy1);
+		_addDamage(sx1, sy1, sx2, sy2);
+		return;
+	}
+
+	// Cohen-Sutherland outcodes, both ends on the same outer side
+	// means nothing to draw
+	int code1 = _outcode(sx1, sy1), code2 = _outcode(sx2, sy2);
+	if (code1 & code2)
+		return;
+
+	// walk along the major axis; m is the major coordinate, n the minor
+	bool xmajor = abs(sx2-sx1) >= abs(sy2-sy1);
+	int m1 = xmajor ? sx1 : sy1, m2 = xmajor ? sx2 : sy2;
+	int n1 = xmajor ? sy1 : sx1, n2 = xmajor ? sy2 : sx2;
+	int cm1 = xmajor ? clip.x1 : clip.y1, cm2 = xmajor ? clip.x2 : clip.y2;
+	int cn1 = xmajor ? clip.y1 : clip.x1, cn2 = xmajor ? clip.y2 : clip.x2;
+	int md = abs(m2-m1), nd = abs(n2-n1);
+	int mstep = m2>m1 ? 1 : -1, nstep = n2>n1 ? 1 : -1;
+	long long t0 = -(md >> 1);
+	if (md==1)
+		t0 = -1;
+	long long kmin = 0, kmax = md;
+
+	if (code1 | code2) {
+		// the minor coordinate after k steps is n1 + nstep * r(k) with
+		// r(k) = floor((t0 + k*nd) / md) + 1, clamp k to the steps that
+		// land inside the clip rectangle on both axes
+		long long lo = mstep>0 ? cm1 - m1 : m1 - cm2;
+		long long hi = mstep>0 ? cm2 - m1 : m1 - cm1;
+		long long rmin = nstep>0 ? cn1 - n1 : n1 - cn2;
+		long long rmax = nstep>0 ? cn2 - n1 : n1 - cn1;
+		if (lo>kmin) kmin = lo;
+		if (hi<kmax) kmax = hi;
+		if (rmax<0)
+			return;
+		if (rmin>0) {
+			long long k = -_floordiv(-((rmin-1)*md - t0), nd);
+			if (k>kmin) kmin = k;
+		}
+		long long k = _floordiv(rmax*md - t0 - 1, nd);
+		if (k<kmax) kmax = k;
+		if (kmin>kmax)
+			return;
+	}
+
+	long long r = _minorSteps(t0, kmin, nd, md);
+	int t = t0 + kmin*nd - r*md;
+	int m = m1 + kmin*mstep, n = n1 + r*nstep;
+	int x = xmajor ? m : n, y = xmajor ? n : m;
+	int line = surface.stride;
+	int mofs = xmajor ? bypp*mstep : line*mstep;
+	int nofs = xmajor ? line*nstep : bypp*nstep;
+	char *p = wbp + y*line + x*bypp;
+
+	if (alpha_w<256) {
+		for (long long k=kmin; k<=kmax; k++) {
+			_store(p, native_color);
+			p += mofs;
+			t += nd;
+			if (t >= 0) {
+				p += nofs;
+				t -= md;
+			}
+		}
+	} else
+		ops->line(p, kmax - kmin + 1, mofs, nofs, t, nd, md, native_color);
+	STAT_PIXELS(kmax - kmin + 1);
+
+	long long re = _minorSteps(t0, kmax, nd, md);
+	int em = m1 + kmax*mstep, en = n1 + re*nstep;
+	_addDamage(x, y, xmajor ? em : en, xmajor ? en : em);
+}
+
+void RTFT::drawHLine(unsigned short int x, unsigned short int y, 
+short int l) {
+	STAT_PROBE(STAT_DRAWHLINE);
+	if (recording) {
+		_args(_record(STAT_DRAWHLINE, x, y, x + l, y), x, y, l);
+		return;
+	}
+	int sx = x + clip.ox, sy = y + clip.oy;
+	if (l<0) {
+		l = -l;
+		sx -= l;
+	}
+	_hline(sx, sy, l);
+	_addDamage(sx, sy, sx + l, sy);
+}
+
+void RTFT::drawVLine(unsigned short int x, unsigned short int y, 
+short int l) {
+	STAT_PROBE(STAT_DRAWVLINE);
+	if (recording) {
+		_args(_record(STAT_DRAWVLINE, x, y, x, y + l), x, y, l);
+		return;
+	}
+	int sx = x + clip.ox, sy = y + clip.oy;
+	if (l<0) {
+		l = -l;
+		sy -= l;
+	}
+	_vline(sx, sy, l);
+	_addDamage(sx, sy, sx, sy + l);
+}
+
+// Blends the current color at coverage cov, in screen coordinates.
+void RTFT::_aaPixel(int x, int y, int cov) {
+	unsigned char m = cov;
+	if (cov<=0 || x<clip.x1 || x>clip.x2 || y<clip.y1 || y>clip.y2)
+		return;
+	ops->blend(wbp + y * surface.stride + x * bypp, 1, NULL, native_color, &m, alpha_w);
+	STAT_PIXELS(1);
+}
+
+// Wu's line in 16.16 fixed point. Straight and 45 degree lines have 
+// no partial pixels and are drawn by drawLine.
+void RTFT::drawLineAA(unsigned short int x1, unsigned short int y1, 
+unsigned short int x2, unsigned short int y2) {
+	STAT_PROBE(STAT_DRAWLINEAA);
+	if (recording) {
+		_args(_record(STAT_DRAWLINEAA, (x1<x2 ? x1 : x2) - 1, (y1<y2 ? y1 : y2) - 1, 
+			(x1>x2 ? x1 : x2) + 1, (y1>y2 ? y1 : y2) + 1), x1, y1, x2, y2);
+		return;
+	}
+	int dx = x2 - x1, dy = y2 - y1;
+	if (dx==0 || dy==0 || abs(dx)==abs(dy)) {
+		drawLine(x1, y1, x2, y2);
+		return;
+	}
+
+	// step along the major axis m, left to right or top to bottom
+	bool xmajor = abs(dx) > abs(dy);
+	int m1 = xmajor ? x1 : y1, m2 = xmajor ? x2 : y2;
+	int n1 = xmajor ? y1 : x1, n2 = xmajor ? y2 : x2;
+	if (m1>m2) {
+		swap(int, m1, m2);
+		swap(int, n1, n2);
+	}
+	int mo = xmajor ? clip.ox : clip.oy, no = xmajor ? clip.oy : clip.ox;
+	int cm1 = xmajor ? clip.x1 : clip.y1, cm2 = xmajor ? clip.x2 : clip.y2;
+	m1 += mo;
+	m2 += mo;
+	long long grad = (long long)(n2 - n1) * 65536 / (m2 - m1);
+	int kmin = cm1 - m1 > 0 ? cm1 - m1 : 0;
+	int kmax = cm2 - m1 < m2 - m1 ? cm2 - m1 : m2 - m1;
+
+	for (int k=kmin; k<=kmax; k++) {
+		long long n = (long long)(n1 + no) * 65536 + k * grad;
+		int ni = n >> 16, f = (n >> 8) & 0xFF;
+		if (xmajor) {
+			_aaPixel(m1 + k, ni, 255 - f);
+			_aaPixel(m1 + k, ni + 1, f);
+		} else {
+			_aaPixel(ni, m1 + k, 255 - f);
+			_aaPixel(ni + 1, m1 + k, f);
+		}
+	}
+	if (xmajor)
+		_addDamage(m1, (n1<n2 ? n1 : n2) + no, m2, (n1>n2 ? n1 : n2) + no + 1);
+	else
+		_addDamage((n1<n2 ? n1 : n2) + no, m1, (n1>n2 ? n1 : n2) + no + 1, m2);
+}
+
+// Wu's circle: for every column of the octant next to the vertical the
+// exact height comes from an integer square root in 24.8, the octants
+// are mirrored. The pixel on the 45 degree line is only drawn once.
+void RTFT::_circleAA(int cx, int cy, int r, int start, int end) {
+	_arc arc;
+	_arcSetup(arc, start, end);
+	if (r==0) {
+		_aaPixel(cx, cy, 255);
+		return;
+	}
+
+	long long r2 = (long long)r * r;
+	int xe = _isqrt(r2 / 2);
+	for (int x=0; x<=xe; x++) {
+		long long y = _isqrt((r2 - (long long)x * x) << 16);
+		int yi = y >> 8, f = y & 0xFF;
+		// (a,b) on the octants above and below the centre, (b,a) on the
+		// ones left and right of it
+		for (int o=0; o<2; o++) {
+			for (int i=0; i<2; i++) {
+				int a = x, b = yi + i, cov = i ? f : 255 - f;
+				if (o && x==xe && yi==xe && i==0)
+					continue;
+				if (o)
+					swap(int, a, b);
+				for (int q=0; q<4; q++) {
+					int px = q & 1 ? -a : a, py = q & 2 ? -b : b;
+					if ((q & 1 && a==0) || (q & 2 && b==0))
+						continue;
+					if (_onArc(arc, px, py))
+						_aaPixel(cx + px, cy + py, cov);
+				}
+			}
+		}
+	}
+}
+
+void RTFT::drawCircleAA(unsigned short int x, unsigned short int y, 
+unsigned short int radius) {
+	drawArcAA(x, y, radius, 0, 360);
+}
+
+// Arc from start clockwise to end, in degrees from the 3 o'clock 
+// direction. An arc of 360 degrees or more is a whole circle.
+void RTFT::drawArcAA(unsigned short int x, unsigned short int y, 
+unsigned short int radius, unsigned short int start, unsigned short int end) {
+	STAT_PROBE(STAT_DRAWARCAA);
+	if (recording) {
+		_args(_record(STAT_DRAWARCAA, x - radius - 1, y - radius - 1, x + radius + 1, 
+			y + radius + 1), x, y, radius, start, end);
+		return;
+	}
+	int cx = x + clip.ox, cy = y + clip.oy;
+	int bx1 = cx - radius - 1, by1 = cy - radius - 1;
+	int bx2 = cx + radius + 1, by2 = cy + radius + 1;
+
+	if (!_clipRect(bx1, by1, bx2, by2))
+		return;
+	_addDamage(bx1, by1, bx2, by2);
+	_circleAA(cx, cy, radius, start, end);
+}
+
+// Spans in screen coordinates, trimmed to the clip rectangle once.
+void RTFT::_hline(int x, int y, int l) {
+	if (l<0) {
+		l = -l;
+		x -= l;
+	}
+	int x2 = x + l;
+	if (y<clip.y1 || y>clip.y2)
+		return;
+	if (x<clip.x1) x = clip.x1;
+	if (x2>clip.x2) x2 = clip.x2;
+	if (x>x2)
+		return;
+	if (alpha_w<256)
+		ops->blend(wbp + y * surface.stride + x * bypp, x2 - x + 1, NULL, native_color, 
+			NULL, alpha_w);
+	else
+		ops->fill(wbp + y * surface.stride + x * bypp, x2 - x + 1, native_color);
+	STAT_PIXELS(x2 - x + 1);
+}
+
+void RTFT::_vline(int x, int y, int l) {
+	if (l<0) {
+		l = -l;
+		y -= l;
+	}
+	int y2 = y + l;
+	if (x<clip.x1 || x>clip.x2)
+		return;
+	if (y<clip.y1) y = clip.y1;
+	if (y2>clip.y2) y2 = clip.y2;
+
+	if (y>y2)
+		return;
+	if (alpha_w<256) {
+		char *p = wbp + y * surface.stride + x * bypp;
+		for (int i=y; i<=y2; i++, p+=surface.stride)
+			ops->blend(p, 1, NULL, native_color, NULL, alpha_w);
+	} else
+		ops->vspan(wbp + y * surface.stride + x * bypp, y2 - y + 1, 
+			surface.stride, native_color);
+	STAT_PIXELS(y2 - y + 1);
+}
+
+int RTFT::_outcode(int x, int y) {
+	return (x<clip.x1 ? 1 : 0) | (x>clip.x2 ? 2 : 0) | 
+		(y<clip.y1 ? 4 : 0) | (y>clip.y2 ? 8 : 0);
+}
+
+// Trims a box in screen coordinates to the clip rectangle, false when
+// nothing is left.
+bool RTFT::_clipRect(int &x1, int &y1, int &x2, int &y2) {
+	if (x1<clip.x1) x1 = clip.x1;
+	if (y1<clip.y1) y1 = clip.y1;
+	if (x2>clip.x2) x2 = clip.x2;
+	if (y2>clip.y2) y2 = clip.y2;
+	return x1<=x2 && y1<=y2;
+}
+
+void RTFT::printChar(unsigned char c, unsigned short int x, 
+unsigned short int y) {
+	int index = _glyphIndex(c);
+	if (index>=0)
+		_drawGlyph(index, x, y);
+}
+
+// The code point at p, moving p past it. Bytes that are not part of a
+// UTF-8 sequence stand for themselves, as in Latin-1.
+static unsigned int _utf8(const char *&p) {
+	const unsigned char *s = (const unsigned char*)p;
+	unsigned int c = s[0];
+	int n = c>=0xF0 && c<=0xF4 ? 3 : c>=0xE0 && c<=0xEF ? 2 : c>=0xC2 && c<=0xDF ? 1 : 0;
+	unsigned int code = c & (0x3F >> n);
+
+	for (int i=1; i<=n; i++) {
+		if ((s[i] & 0xC0)!=0x80) {
+			n = 0;
+			break;
+		}
+		code = code << 6 | (s[i] & 0x3F);
+	}
+	// overlong forms, surrogates and beyond 0x10FFFF
+	if ((n==2 && (code<0x800 || (code>=0xD800 && code<0xE000))) ||
+			(n==3 && (code<0x10000 || code>0x10FFFF)))
+		n = 0;
+	p += n + 1;
+	return n ? code : c;
+}
+
+// Glyph of code point code in the current font, -1 when it has none.
+int RTFT::_glyphIndex(unsigned int code) {
+	const _font *f = cfont.prop;
+
+	if (!f)
+		return code>=cfont.offset && code<(unsigned int)cfont.offset + cfont.numchars ?
+			code - cfont.offset : -1;
+	if (code<FONT_DIRECT)
+		return f->direct[code] - 1;
+	int lo = 0, hi = f->range_count - 1;
+	while (lo<=hi) {
+		int mid = (lo + hi) / 2;
+		const _font_range *r = &f->ranges[mid];
+		if (code<r->first)
+			hi = mid - 1;
+		else if (code>=r->first + r->count)
+			lo = mid + 1;
+		else
+			return r->glyph + code - r->first;
+	}
+	return -1;
+}
+
+// Change of the advance between glyphs left and right of a proportional
+// font.
+static int _kerning(const _font *f, int left, int right) {
+	const _font_glyph *g = &f->glyphs[left];
+	for (int i=g->kern; i<g->kern + g->kerns; i++)
+		if (f->kerns[i].right==right)
+			return f->kerns[i].adjust;
+	return 0;
+}
+
+// Rows of glyph index of the current font, w columns of bpr bytes.
+const unsigned char* RTFT::_glyphBits(int index, int &w, int &bpr) {
+	if (cfont.prop) {
+		const _font_glyph *g = &cfont.prop->glyphs[index];
+		w = g->width;
+		bpr = (w + 7) / 8;
+		return g->bits;
+	}
+	w = cfont.x_size;
+	bpr = w / 8;
+	return cfont.font + 4 + index * bpr * cfont.y_size;
+}
+
+// Draws glyph index of the current font with the pen at x, y. Opaque
+// glyphs of proportional fonts fill the rest of their advance in the
+// back color.
+void RTFT::_drawGlyph(int index, int x, int y) {
+	STAT_PROBE(STAT_PRINTCHAR);
+	int w, bpr;
+	const unsigned char *bits = _glyphBits(index, w, bpr);
+	int left = 0, advance = w;
+
+	if (cfont.prop) {
+		left = cfont.prop->glyphs[index].left;
+		advance = cfont.prop->glyphs[index].advance;
+	}
+	if (recording) {
+		int bx1 = x + left, bx2 = x + left + w - 1;
+		if (!_transparent) {
+			bx1 = x + (left<0 ? left : 0);
+			bx2 = x + (left + w>advance ? left + w : advance) - 1;
+		}
+		if (bx1>bx2)
+			return;
+		_command *cmd = _record(STAT_PRINTCHAR, bx1, y, bx2, y + cfont.y_size - 1);
+		_args(cmd, x, y);
+		if (cmd)
+			cmd->param = index;
+		return;
+	}
+	if (cfont.prop && !_transparent) {
+		_fillBack(x, y, x + (left<advance ? left : advance) - 1, y + cfont.y_size - 1);
+		_fillBack(x + (left + w>0 ? left + w : 0), y, x + advance - 1, y + cfont.y_size - 1);
+	}
+	x += left;
+	int sx1 = x + clip.ox, sy1 = y + clip.oy;
+	int sx2 = sx1 + w - 1, sy2 = sy1 + cfont.y_size - 1;
+
+	if (!_clipRect(sx1, sy1, sx2, sy2))
+		return;
+	_addDamage(sx1, sy1, sx2, sy2);
+
+	// visible rows and columns of the glyph
+	int col1 = sx1 - (x + clip.ox), col2 = sx2 - (x + clip.ox);
+	int row1 = sy1 - (y + clip.oy), row2 = sy2 - (y + clip.oy);
+	char *line = wbp + sy1 * surface.stride + sx1 * bypp;
+	STAT_PIXELS((row2 - row1 + 1) * (col2 - col1 + 1));
+
+	if (cfont.spans && (_transparent || alpha_w<256)) {
+		_spanGlyph(line, index, row1, row2, col1, col2);
+		return;
+	}
+	if (alpha_w<256) {
+		// blend each row through masks of its set and clear bits
+		unsigned char fg[256], bg[256];
+		int n = col2 - col1 + 1;
+		for (int row=row1; row<=row2; row++, line+=surface.stride) {
+			const unsigned char *b = bits + row * bpr;
+			for (int col=col1; col<=col2; col++) {
+				fg[col - col1] = (b[col>>3] & (0x80>>(col&7))) ? 255 : 0;
+				bg[col - col1] = ~fg[col - col1];
+			}
+			ops->blend(line, n, NULL, native_color, fg, alpha_w);
+			if (!_transparent)
+				ops->blend(line, n, NULL, native_back_color, bg, alpha_w);
+		}
+		return;
+	}
+
+	const _glyph *g = _getGlyph(index);
+
+	if (cfont.spans && (!g || !g->expanded)) {
+		_spanGlyph(line, index, row1, row2, col1, col2);
+	} else if (!g) {
+		// out of memory, decode the font bits directly
+		ops->glyph(line, surface.stride, bits + row1 * bpr, bpr, 
+			row2 - row1 + 1, col1, col2, native_color, native_back_color, _transparent);
+	} else if (!g->transparent) {
+		int stride = w * bypp, len = (col2 - col1 + 1) * bypp;
+		const char *src = g->pixels + row1 * stride + col1 * bypp;
+		for (int row=row1; row<=row2; row++, src+=stride, line+=surface.stride)
+			memcpy(line, src, len);
+	} else {
+		// runs are (start, length) pairs, row r owns runs[r]..runs[r+1]
+		const unsigned short *pairs = g->runs + cfont.y_size + 1;
+		for (int row=row1; row<=row2; row++, line+=surface.stride)
+			for (int i=g->runs[row]; i<g->runs[row+1]; i+=2) {
+				int r1 = pairs[i], r2 = pairs[i] + pairs[i+1] - 1;
+				if (r1<col1) r1 = col1;
+				if (r2>col2) r2 = col2;
+				if (r1<=r2)
+					ops->fill(line + (r1 - col1) * bypp, r2 - r1 + 1, native_color);
+			}
+	}
+}
+
+// Fills x1..x2, y1..y2 in the back color, with the current alpha.
+void RTFT::_fillBack(int x1, int y1, int x2, int y2) {
+	x1 += clip.ox;
+	y1 += clip.oy;
+	x2 += clip.ox;
+	y2 += clip.oy;
+	if (x1>x2 || !_clipRect(x1, y1, x2, y2))
+		return;
+	_addDamage(x1, y1, x2, y2);
+
+	char *row = wbp + y1 * surface.stride + x1 * bypp;
+	STAT_PIXELS((x2 - x1 + 1) * (y2 - y1 + 1));
+	for (int y=y1; y<=y2; y++, row+=surface.stride) {
+		if (alpha_w<256)
+			ops->blend(row, x2 - x1 + 1, NULL, native_back_color, NULL, alpha_w);
+		else
+			ops->fill(row, x2 - x1 + 1, native_back_color);
+	}
+}
+
+// Draws rows row1..row2 and columns col1..col2 of glyph index from the
+// compiled runs of the font, the runs in the color and the gaps between
+// them in the back color unless the font is transparent.
+void RTFT::_spanGlyph(char *line, int index, int row1, int row2, int col1, int col2) {
+	const unsigned short *rows = cfont.spans->rows + index * cfont.y_size;
+	const unsigned char *runs = cfont.spans->runs;
+
+	if (alpha_w==256) {
+		ops->runs(line, surface.stride, rows + row1, runs, row2 - row1 + 1, col1, col2, 
+			native_color, native_back_color, _transparent);
+		return;
+	}
+	// translucent, blend span by span
+	for (int row=row1; row<=row2; row++, line+=surface.stride) {
+		int x = col1;
+		for (int i=rows[row]; i<rows[row + 1]; i+=2) {
+			int r1 = runs[i], r2 = runs[i] + runs[i + 1] - 1;
+			if (r2<x)
+				continue;
+			if (r1>col2)
+				break;
+			if (r1<x)
+				r1 = x;
+			if (r2>col2)
+				r2 = col2;
+			if (!_transparent && r1>x)
+				ops->blend(line + (x - col1) * bypp, r1 - x, NULL, native_back_color, NULL, alpha_w);
+			ops->blend(line + (r1 - col1) * bypp, r2 - r1 + 1, NULL, native_color, NULL, alpha_w);
+			x = r2 + 1;
+		}
+		if (!_transparent && x<=col2)
+			ops->blend(line + (x - col1) * bypp, col2 - x + 1, NULL, native_back_color, NULL, alpha_w);
+	}
+}
+
+// Looks up a glyph of the current font for the current colors. On a
+// miss the least recently used entry is expanded again. NULL when out
+// of memory.
+const _glyph* RTFT::_getGlyph(int index) {
+	unsigned int fg = _transparent ? 0 : native_color;
+	unsigned int bg = _transparent ? 0 : native_back_color;
+	_glyph *g;
+
+	glyph_tick++;
+	for (int i=0; i<glyph_count; i++) {
+		g = &glyphs[i];
+		if (g->index==index && g->font==cfont.font && g->transparent==_transparent &&
+				g->fg==fg && g->bg==bg) {
+			g->used = glyph_tick;
+			glyph_hits++;
+			if (!g->expanded && _expandGlyph(g, index))
+				g->expanded = true;
+			return g;
+		}
+	}
+
+	glyph_misses++;
+	if (glyph_count<GLYPH_CACHE)
+		g = &glyphs[glyph_count++];
+	else {
+		g = &glyphs[0];
+		for (int i=1; i<GLYPH_CACHE; i++)
+			if (glyphs[i].used<g->used)
+				g = &glyphs[i];
+	}
+	g->font = cfont.font;
+	g->index = index;
+	g->transparent = _transparent;
+	g->fg = fg;
+	g->bg = bg;
+	g->used = glyph_tick;
+	// compiled glyphs are drawn from their runs until used again
+	g->expanded = false;
+	if (cfont.spans)
+		return g;
+	if (!_expandGlyph(g, index)) {
+		// leave the entry unmatchable
+		g->font = NULL;
+		return NULL;
+	}
+	g->expanded = true;
+	return g;
+}
+
+bool RTFT::_expandGlyph(_glyph *g, int index) {
+	int w, bpr;
+	const unsigned char *bits = _glyphBits(index, w, bpr);
+	long int size;
+	int n = 0;
+
+	if (!_transparent)
+		size = (long int)w * cfont.y_size * bypp;
+	else {
+		// count the runs first
+		for (int row=0; row<cfont.y_size; row++)
+			for (int col=0; col<w; col++)
+				if ((bits[row*bpr + (col>>3)] & (0x80>>(col&7))) && 
+						(col==0 || !(bits[row*bpr + ((col-1)>>3)] & (0x80>>((col-1)&7)))))
+					n++;
+		size = (cfont.y_size + 1 + 2*n) * sizeof(unsigned short);
+	}
+	if (size>g->size) {
+		char *p = (char*)realloc(g->pixels, size);
+		if (!p)
+			return false;
+		g->pixels = p;
+		g->size = size;
+	}
+
+	if (!_transparent) {
+		if (cfont.spans)
+			ops->runs(g->pixels, w * bypp, cfont.spans->rows + index * cfont.y_size,
+				cfont.spans->runs, cfont.y_size, 0, w - 1, native_color, native_back_color,
+				false);
+		else
+			ops->glyph(g->pixels, w * bypp, bits, bpr, cfont.y_size,
+				0, w - 1, native_color, native_back_color, false);
+		return true;
+	}
+	g->runs = (unsigned short*)g->pixels;
+	unsigned short *pairs = g->runs + cfont.y_size + 1;
+	n = 0;
+	for (int row=0; row<cfont.y_size; row++, bits+=bpr) {
+		g->runs[row] = n;
+		for (int col=0; col<w; col++) {
+			if (!(bits[col>>3] & (0x80>>(col&7))))
+				continue;
+			int start = col;
+			while (col+1<w && (bits[(col+1)>>3] & (0x80>>((col+1)&7))))
+				col++;
+			pairs[n++] = start;
+			pairs[n++] = col - start + 1;
+		}
+	}
+	g->runs[cfont.y_size] = n;
+	return true;
+}
+
+unsigned long RTFT::getGlyphHits() {
+	return glyph_hits;
+}
+
+unsigned long RTFT::getGlyphMisses() {
+	return glyph_misses;
+}
+
+void RTFT::clearGlyphCache() {
+	for (int i=0; i<GLYPH_CACHE; i++) {
+		free(glyphs[i].pixels);
+		glyphs[i].pixels = NULL;
+		glyphs[i].size = 0;
+	}
+	glyph_count = 0;
+}
+
+void RTFT::rotateChar(unsigned char c, unsigned short x, 
+unsigned short y, int pos, unsigned short deg) {
+	int index = _glyphIndex(c);
+	if (index>=0)
+		_rotateGlyph(index, x, y, pos * cfont.x_size, deg);
+}
+
+// Draws glyph index rotated by deg around x, y with the pen pen pixels
+// along the text.
+void RTFT::_rotateGlyph(int index, int x, int y, int pen, unsigned short deg) {
+	STAT_PROBE(STAT_ROTATECHAR);
+	int w, bpr;
+	const unsigned char *bits = _glyphBits(index, w, bpr);
+	int left = 0, advance = w;
+	_affine a;
+
+	if (cfont.prop) {
+		left = cfont.prop->glyphs[index].left;
+		advance = cfont.prop->glyphs[index].advance;
+	}
+	// the glyph, and opaque the rest of the advance
+	int u1 = pen + left, u2 = pen + left + w - 1;
+	if (!_transparent) {
+		u1 = pen + (left<0 ? left : 0);
+		u2 = pen + (left + w>advance ? left + w : advance) - 1;
+	}
+	if (u1>u2)
+		return;
+
+	if (recording) {
+		_affineSetup(a, x, y, u1, 0, u2, cfont.y_size - 1, deg);
+		_command *cmd = _record(STAT_ROTATECHAR, a.x1, a.y1, a.x2, a.y2);
+		_args(cmd, x, y, pen, deg);
+		if (cmd)
+			cmd->param = index;
+		return;
+	}
+
+	_affineSetup(a, x + clip.ox, y + clip.oy, u1, 0, u2, cfont.y_size - 1, deg);
+	int bx1 = a.x1, by1 = a.y1, bx2 = a.x2, by2 = a.y2;
+	if (!_clipRect(bx1, by1, bx2, by2))
+		return;
+	_addDamage(bx1, by1, bx2, by2);
+
+	for (int py=by1; py<=by2; py++) {
+		int x1 = bx1, x2 = bx2, u, v;
+		if (!_affineRow(a, py, x1, x2, u, v))
+			continue;
+		char *p = wbp + py * surface.stride + x1 * bypp;
+		STAT_PIXELS(x2 - x1 + 1);
+		// glyph coordinates, pixel centres on whole numbers
+		u -= (pen + left) * 65536;
+		if (rotate_filter==ROTATE_BILINEAR) {
+			for (int px=x1; px<=x2; px++, p+=bypp, u+=a.c, v-=a.s) {
+				int c0 = u >> 16, r0 = v >> 16;
+				int wx = (u >> 8) & 0xFF, wy = (v >> 8) & 0xFF;
+				int b[4];
+				for (int i=0; i<4; i++) {
+					int col = c0 + (i & 1), row = r0 + (i >> 1);
+					b[i] = col>=0 && col<w && row>=0 && row<cfont.y_size &&
+						(bits[row*bpr + (col>>3)] & (0x80>>(col&7)));
+				}
+				int cov = ((b[0]*(256-wx) + b[1]*wx) * (256-wy) + 
+					(b[2]*(256-wx) + b[3]*wx) * wy) >> 8;
+				if (!_transparent)
+					_store(p, ops->convert(_mix565(current_back_color, current_color, cov)));
+				else if (cov>=128)
+					_store(p, native_color);
+			}
+		} else {
+			u += 0x8000;
+			v += 0x8000;
+			for (int px=x1; px<=x2; px++, p+=bypp, u+=a.c, v-=a.s) {
+				int col = u >> 16, row = v >> 16;
+				if (col>=0 && col<w && (bits[row*bpr + (col>>3)] & (0x80>>(col&7))))
+					_store(p, native_color);
+				else if (!_transparent)
+					_store(p, native_back_color);
+			}
+		}
+	}
+}
+
+// Prints st, UTF-8 or Latin-1, from x, y. Characters the font lacks
+// take a cell of a UTFT font and nothing of a proportional one.
+void RTFT::print(char *st, unsigned short int x, unsigned short int y,
+unsigned short int deg) {
+	STAT_PROBE(STAT_PRINT);
+	int n = strlen(st), x0 = x;
+
+	if (x==RIGHT)
+		x0 = clip.w - _lineWidth(st, n);
+	if (x==CENTER)
+		x0 = (clip.w - _lineWidth(st, n)) / 2;
+	_printLine(st, n, x0, y, deg);
+}
+
+// Width in pixels of st printed in the current font.
+int RTFT::getTextWidth(const char *st) {
+	return _lineWidth(st, strlen(st));
+}
+
+// Prints n bytes of st with the pen from x, y, or rotated by deg around
+// x, y.
+void RTFT::_printLine(const char *st, int n, int x, int y, unsigned short deg) {
+	int pen = 0, prev = -1;
+
+	for (const char *p=st; p<st + n; ) {
+		int index = _glyphIndex(_utf8(p));
+		if (index<0) {
+			pen += cfont.prop ? 0 : cfont.x_size;
+			prev = -1;
+			continue;
+		}
+		if (prev>=0 && cfont.prop)
+			pen += _kerning(cfont.prop, prev, index);
+		if (deg==0)
+			_drawGlyph(index, x + pen, y);
+		else
+			_rotateGlyph(index, x, y, pen, deg);
+		pen += cfont.prop ? cfont.prop->glyphs[index].advance : cfont.x_size;
+		prev = index;
+	}
+}
+
+// Pen movement of code point code after glyph prev, kerning included,
+// and prev becomes its glyph.
+int RTFT::_advance(unsigned int code, int &prev) {
+	int index = _glyphIndex(code), a;
+
+	if (!cfont.prop)
+		a = cfont.x_size;
+	else if (index<0)
+		a = 0;
+	else
+		a = cfont.prop->glyphs[index].advance +
+			(prev>=0 ? _kerning(cfont.prop, prev, index) : 0);
+	prev = index;
+	return a;
+}
+
+int RTFT::_lineWidth(const char *st, int n) {
+	int pen = 0, prev = -1;
+
+	for (const char *p=st; p<st + n; )
+		pen += _advance(_utf8(p), prev);
+	return pen;
+}
+
+//*********************************
+// TEXT BOXES
+//*********************************
+// printBox() breaks a text into the lines that fit a box and aligns
+// them in it. Layouts are cached by text, font, box and flags, and an
+// opaque box drawn whole keeps its pixels, so a label that did not
+// change is copied to the screen instead of laid out and drawn again.
+
+// An ellipsis in the current font, the character or three dots.
+const char* RTFT::_ellipsis() {
+	return _glyphIndex(0x2026)>=0 ? "\xE2\x80\xA6" : "...";
+}
+
+// Bytes of the n of st that fit in width pixels followed by an
+// ellipsis, all of them for no width.
+int RTFT::_trimLine(const char *st, int n, int width) {
+	const char *ell = _ellipsis();
+	int room = width - _lineWidth(ell, strlen(ell)), pen = 0, prev = -1;
+	const char *p = st, *fit = st;
+
+	if (!width)
+		return n;
+	while (p<st + n) {
+		pen += _advance(_utf8(p), prev);
+		if (pen>room)
+			break;
+		fit = p;
+	}
+	while (fit>st && fit[-1]==' ')
+		fit--;
+	return fit - st;
+}
+
+// Breaks st into lines at line feeds and, with TEXT_WRAP, at the last
+// space that keeps them within width, or inside a word longer than a
+// line. Lines past max, when not 0, are left out. With TEXT_ELLIPSIS a
+// line cut short ends in an ellipsis. The number of lines, -1 when out
+// of memory.
+int RTFT::_layoutLines(const char *st, int width, int max, unsigned char flags,
+_text_line **out) {
+	bool wrap = (flags & TEXT_WRAP) && width;
+	const char *p = st;
+	_text_line *lines = NULL;
+	int count = 0, size = 0;
+
+	while (*p && (!max || count<max)) {
+		const char *start = p, *end, *brk = NULL;
+		int pen = 0, prev = -1, brk_pen = 0;
+		for (;;) {
+			const char *q = p;
+			if (!*p || *p=='\n') {
+				end = p;
+				if (*p)
+					p++;
+				break;
+			}
+			unsigned int code = _utf8(p);
+			int a = _advance(code, prev);
+			if (code==' ' && q>start) {
+				brk = q;
+				brk_pen = pen;
+			}
+			if (wrap && pen + a>width && q>start) {
+				if (brk) {
+					// at the space, which goes with the ones after it
+					end = p = brk;
+					pen = brk_pen;
+					while (*p==' ')
+						p++;
+					if (*p=='\n')
+						p++;
+				} else
+					end = p = q;
+				break;
+			}
+			pen += a;
+		}
+
+		if (count==size) {
+			size = size ? size * 2 : 8;
+			_text_line *l = (_text_line*)realloc(lines, size * sizeof(_text_line));
+			if (!l) {
+				free(lines);
+				return -1;
+			}
+			lines = l;
+		}
+		_text_line *l = &lines[count++];
+		l->start = start - st;
+		l->length = end - start;
+		l->width = pen;
+		l->ellipsis = (flags & TEXT_ELLIPSIS) && ((width && pen>width) ||
+			(count==max && *p));
+		if (l->ellipsis) {
+			const char *ell = _ellipsis();
+			l->length = _trimLine(start, l->length, width);
+			l->width = _lineWidth(start, l->length) + _lineWidth(ell, strlen(ell));
+		}
+	}
+	*out = lines;
+	return count;
+}
+
+// The layout of st in a box of width by height with flags, from the
+// cache or made and cached. NULL when out of memory.
+_text_layout* RTFT::_layoutText(const char *st, int width, int height, unsigned char flags) {
+	unsigned int hash = 2166136261u;
+	_text_layout *t;
+
+	for (const unsigned char *p=(const unsigned char*)st; *p; p++)
+		hash = (hash ^ *p) * 16777619u;
+	text_tick++;
+	for (int i=0; i<text_count; i++) {
+		t = &texts[i];
+		if (t->hash==hash && t->font==cfont.font && t->width==width &&
+				t->height==height && t->flags==flags && !strcmp(t->text, st)) {
+			t->used = text_tick;
+			return t;
+		}
+	}
+
+	if (text_count<TEXT_CACHE)
+		t = &texts[text_count++];
+	else {
+		t = &texts[0];
+		for (int i=1; i<TEXT_CACHE; i++)
+			if (texts[i].used<t->used)
+				t = &texts[i];
+	}
+	free(t->text);
+	free(t->lines);
+	free(t->pixels);
+	t->lines = NULL;
+	t->pixels = NULL;
+	t->text = strdup(st);
+
+	// with an ellipsis the lines that fit, at least one
+	int max = 0;
+	if ((flags & TEXT_ELLIPSIS) && height)
+		max = height / cfont.y_size>1 ? height / cfont.y_size : 1;
+	t->count = t->text ? _layoutLines(t->text, width, max, flags, &t->lines) : -1;
+	if (t->count<0) {
+		// leave the entry unmatchable
+		free(t->text);
+		t->text = NULL;
+		t->font = NULL;
+		return NULL;
+	}
+	t->hash = hash;
+	t->font = cfont.font;
+	t->width = width;
+	t->height = height;
+	t->flags = flags;
+	t->used = text_tick;
+	return t;
+}
+
+// Prints st in the box x1, y1 to x2, y2 with the alignment of flags, in
+// lines broken at line feeds and, with TEXT_WRAP, where the box ends.
+// Lines that overflow the box are clipped to it, or with TEXT_ELLIPSIS
+// the last one that fits ends in an ellipsis. An opaque box is filled
+// in the back color. Display lists have no clip rectangles, so there
+// the lines the box cuts are left out.
+void RTFT::printBox(const char *st, unsigned short int x1, unsigned short int y1,
+unsigned short int x2, unsigned short int y2, unsigned char flags) {
+	STAT_PROBE(STAT_PRINTBOX);
+	if (x1>x2) swap(unsigned short int, x1, x2);
+	if (y1>y2) swap(unsigned short int, y1, y2);
+	int w = x2 - x1 + 1, h = y2 - y1 + 1;
+	_text_layout *t = cfont.font ? _layoutText(st, w, h, flags) : NULL;
+
+	if (!t)
+		return;
+
+	// an opaque box wholly visible is the same pixels every time
+	int sx1 = x1 + clip.ox, sy1 = y1 + clip.oy, len = w * bypp;
+	bool whole = !recording && !_transparent && alpha_w==256 && (long)len * h<=TEXT_PIXELS &&
+		sx1>=clip.x1 && sy1>=clip.y1 && sx1 + w - 1<=clip.x2 && sy1 + h - 1<=clip.y2;
+	char *row;
+	if (whole && t->pixels && t->color==current_color && t->back==current_back_color) {
+		row = wbp + sy1 * surface.stride + sx1 * bypp;
+		for (int y=0; y<h; y++, row+=surface.stride)
+			memcpy(row, t->pixels + y * len, len);
+		_addDamage(sx1, sy1, sx1 + w - 1, sy1 + h - 1);
+		STAT_PIXELS(w * h);
+		return;
+	}
+
+	bool transparent = _transparent;
+	if (!transparent) {
+		unsigned short fg = current_color;
+		setColor(current_back_color);
+		fillRect(x1, y1, x2, y2);
+		setColor(fg);
+		_transparent = true;
+	}
+	int top = y1, total = t->count * cfont.y_size;
+	if (flags & TEXT_MIDDLE)
+		top += (h - total) / 2;
+	else if (flags & TEXT_BOTTOM)
+		top += h - total;
+	const char *ell = _ellipsis();
+	int ell_w = _lineWidth(ell, strlen(ell));
+
+	if (!recording)
+		_pushClip(x1, y1, x2, y2, false);
+	for (int i=0; i<t->count; i++) {
+		const _text_line *l = &t->lines[i];
+		int x = x1, y = top + i * cfont.y_size;
+		if (recording ? y<y1 || y + cfont.y_size - 1>y2 : y + cfont.y_size<=y1 || y>y2)
+			continue;
+		if (flags & TEXT_CENTER)
+			x += (w - l->width) / 2;
+		else if (flags & TEXT_RIGHT)
+			x += w - l->width;
+		_printLine(t->text + l->start, l->length, x, y, 0);
+		if (l->ellipsis)
+			_printLine(ell, strlen(ell), x + l->width - ell_w, y, 0);
+	}
+	if (!recording)
+		popClip();
+	_transparent = transparent;
+
+	if (whole) {
+		if (!t->pixels)
+			t->pixels = (char*)malloc((long)len * h);
+		if (t->pixels) {
+			row = wbp + sy1 * surface.stride + sx1 * bypp;
+			for (int y=0; y<h; y++, row+=surface.stride)
+				memcpy(t->pixels + y * len, row, len);
+			t->color = current_color;
+			t->back = current_back_color;
+		}
+	}
+}
+
+// Size of st laid out by printBox() in a box width pixels wide, or in
+// lines broken only at line feeds for no width.
+void RTFT::measureText(const char *st, unsigned short int width, _text_size *size) {
+	_text_layout *t = cfont.font ? _layoutText(st, width, 0, width ? TEXT_WRAP : 0) : NULL;
+
+	size->width = 0;
+	size->height = 0;
+	size->lines = 0;
+	if (!t)
+		return;
+	for (int i=0; i<t->count; i++)
+		if (t->lines[i].width>size->width)
+			size->width = t->lines[i].width;
+	size->height = t->count * cfont.y_size;
+	size->lines = t->count;
+}
+
+void RTFT::clearTextCache() {
+	for (int i=0; i<TEXT_CACHE; i++) {
+		free(texts[i].text);
+		free(texts[i].lines);
+		free(texts[i].pixels);
+		texts[i].text = NULL;
+		texts[i].lines = NULL;
+		texts[i].pixels = NULL;
+	}
+	text_count = 0;
+}
+
+static const char digit_pairs[] = 
+	"0001020304050607080910111213141516171819"
+	"2021222324252627282930313233343536373839"
+	"4041424344454647484950515253545556575859"
+	"6061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+// Writes the digits of n backwards, two for every division, ending at
+// end and returns where they start.
+static char* _digits(char *end, unsigned long long n) {
+	while (n>=100) {
+		unsigned long long q = n / 100;
+		const char *d = digit_pairs + (n - q * 100) * 2;
+		*--end = d[1];
+		*--end = d[0];
+		n = q;
+	}
+	if (n>=10) {
+		*--end = digit_pairs[n * 2 + 1];
+		*--end = digit_pairs[n * 2];
+	} else
+		*--end = '0' + n;
+	return end;
+}
+
+// Pads the c digits at d to length into st of NUMFIELD_LEN + 1 chars,
+// with the sign before or after the filler.
+static void _padNumber(char *st, const char *d, int c, bool neg, bool sign_first, 
+int length, char filler) {
+	int k = 0;
+
+	if (length>NUMFIELD_LEN)
+		length = NUMFIELD_LEN;
+	if (neg && sign_first)
+		st[k++] = '-';
+	while (k + c + (neg && !sign_first)<length)
+		st[k++] = filler;
+	if (neg && !sign_first)
+		st[k++] = '-';
+	memcpy(st + k, d, c);
+	st[k + c] = 0;
+}
+
+static void _formatInt(char *st, long num, int length, char filler) {
+	char buf[24];
+	char *d = _digits(buf + sizeof(buf), num<0 ? 0UL - num : num);
+	_padNumber(st, d, buf + sizeof(buf) - d, num<0, true, length, filler);
+}
+
+void RTFT::printNumI(long num, unsigned short int x, unsigned short int y, 
+unsigned char length, char filler) {
+	STAT_PROBE(STAT_PRINTNUMI);
+	char st[NUMFIELD_LEN + 1];
+
+	_formatInt(st, num, length, filler);
+	print(st,x,y);
+}
+
+// The text of printNumF(), as "%*.*f" would have it. A float times a
+// power of ten up to 1e5 is exact in a double, so rounding it to even
+// matches printf.
+void RTFT::_formatNumF(char *st, float num, unsigned char dec, char divider, 
+int length, char filler) {
+	static const double scale[6] = { 1, 10, 100, 1000, 10000, 100000 };
+	double v = fabs((double)num) * scale[dec];
+	char buf[64];
+
+	if (v<1e15) {
+		unsigned long long n = (unsigned long long)nearbyint(v);
+		unsigned long long p = (unsigned long long)scale[dec];
+		char *end = buf + sizeof(buf);
+		char *d = _digits(end, n % p);
+		while (end - d<dec)
+			*--d = '0';
+		*--d = divider;
+		d = _digits(d, n / p);
+		_padNumber(st, d, end - d, signbit(num), filler!=' ', length, filler);
+		return;
+	}
+
+	// infinities, NaN and numbers too long to show whole anyway
+	bool neg = num<0;
+	_convert_float(buf, num, length<NUMFIELD_LEN ? length : NUMFIELD_LEN, dec);
+	buf[NUMFIELD_LEN] = 0;
+	for (char *p=buf; *p; p++) {
+		if (*p=='.')
+			*p = divider;
+		if (filler!=' ' && (*p==' ' || (neg && *p=='-')))
+			*p = filler;
+	}
+	if (neg && filler!=' ')
+		buf[0] = '-';
+	strcpy(st, buf);
+}
+
+void RTFT::printNumF(float num, unsigned char dec, unsigned short int x, 
+unsigned short int y, char divider, unsigned short int length, char filler) {
+	STAT_PROBE(STAT_PRINTNUMF);
+	char st[NUMFIELD_LEN + 1];
+
+	if (dec<1)
+		dec=1;
+	else if (dec>5)
+		dec=5;
+	_formatNumF(st, num, dec, divider, length<NUMFIELD_LEN ? length : NUMFIELD_LEN, filler);
+	print(st,x,y);
+}
+
+//*********************************
+// NUMBER FIELDS
+//*********************************
+// A field remembers the text it shows and prints only the characters
+// that changed, which for a counter or a reading is mostly the last 
+// one or two. Cells are drawn opaque, so a character in the place of
+// another one covers it even with a transparent font.
+
+// Places a field at x, y, with the length and filler of printNumI()
+// and the divider of printNumF().
+void RTFT::initField(_numfield *field, unsigned short int x, unsigned short int y, 
+unsigned char length, char filler, char divider) {
+	field->x = x;
+	field->y = y;
+	field->length = length<NUMFIELD_LEN ? length : NUMFIELD_LEN;
+	field->filler = filler;
+	field->divider = divider;
+	field->count = 0;
+	field->font = NULL;
+	field->text[0] = 0;
+}
+
+// Has the next print draw the whole field, when something was drawn
+// over it.
+void RTFT::resetField(_numfield *field) {
+	field->font = NULL;
+}
+
+void RTFT::printNumI(_numfield *field, long num) {
+	STAT_PROBE(STAT_PRINTNUMI);
+	char st[NUMFIELD_LEN + 1];
+
+	_formatInt(st, num, field->length, field->filler);
+	_printField(field, st);
+}
+
+void RTFT::printNumF(_numfield *field, float num, unsigned char dec) {
+	STAT_PROBE(STAT_PRINTNUMF);
+	char st[NUMFIELD_LEN + 1];
+
+	if (dec<1)
+		dec=1;
+	else if (dec>5)
+		dec=5;
+	_formatNumF(st, num, dec, field->divider, field->length, field->filler);
+	_printField(field, st);
+}
+
+// Prints the characters of st that differ from the ones the field shows
+// and clears the cells it no longer uses. A new font or new colors 
+// redraw it all.
+void RTFT::_printField(_numfield *field, const char *st) {
+	int n = strlen(st);
+	int w = cfont.x_size, h = cfont.y_size;
+	bool all = field->font!=cfont.font || field->color!=current_color || 
+		field->back!=current_back_color;
+	unsigned short fg = current_color;
+	bool transparent = _transparent;
+
+	setColor(current_back_color);
+	if (field->font && field->font!=cfont.font && field->count) {
+		// cells of the old font, which may be larger
+		fillRect(field->x, field->y, field->x + field->count * field->w - 1, 
+			field->y + field->h - 1);
+	}
+	setColor(fg);
+	_transparent = false;
+	for (int i=0; i<n || i<field->count; i++) {
+		if (!all && i<n && i<field->count && st[i]==field->text[i])
+			continue;
+		int index = i<n ? _glyphIndex((unsigned char)st[i]) : -1;
+		int x = field->x + i * w, used = 0;
+		if (index>=0) {
+			_drawGlyph(index, x, field->y);
+			used = cfont.prop ? cfont.prop->glyphs[index].advance : w;
+		}
+		if (used<w) {
+			// gone, not in the font like a '-' in SevenSegNumFont, or
+			// narrower than the widest of a proportional font
+			setColor(current_back_color);
+			fillRect(x + used, field->y, x + w - 1, field->y + h - 1);
+			setColor(fg);
+		}
+	}
+	_transparent = transparent;
+
+	memcpy(field->text, st, n + 1);
+	field->count = n;
+	field->font = cfont.font;
+	field->w = w;
+	field->h = h;
+	field->color = current_color;
+	field->back = current_back_color;
+}
+
+//*********************************
+// FONT REGISTRY
+//*********************************
+// The built in fonts and fonts mapped read only from files, so that
+// processes using the same file share its pages. A file holds the 
+// bytes of a font array, header and glyphs, and is checked against
+// its length once when loaded. Fonts stay loaded until the process 
+// ends, as glyph caches and display lists point into them.
+
+// The one definition of the built in fonts, constexpr so the compiler
+// can build their span tables
+#undef fontdatatype
+#define fontdatatype constexpr unsigned char
+#include <DefaultFonts.c>
+#undef fontdatatype
+#define fontdatatype const unsigned char
+
+RTFT_SPAN_FONT(small_spans, SmallFont);
+RTFT_SPAN_FONT(big_spans, BigFont);
+RTFT_SPAN_FONT(sevenseg_spans, SevenSegNumFont);
+
+static _font font_registry[MAX_FONTS];
+static int font_count = 0;
+static pthread_mutex_t font_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int _le16(const unsigned char *p) {
+	return p[0] | p[1] << 8;
+}
+
+static unsigned int _le32(const unsigned char *p) {
+	return p[0] | p[1] << 8 | p[2] << 16 | (unsigned int)p[3] << 24;
+}
+
+// Bytes a font with header h needs, 0 when no font has that header. A
+// proportional font tells its size, checked by _parseFont().
+static long _fontSize(const unsigned char *h) {
+	if (!memcmp(h, FONT_MAGIC, 4))
+		return _le32(h + 4)<FONT_HEADER ? 0 : _le32(h + 4);
+	if (h[0]==0 || h[0] % 8 || h[1]==0 || h[3]==0 || h[2] + h[3]>256)
+		return 0;
+	return 4 + (long)h[3] * (h[0] / 8) * h[1];
+}
+
+static void _freeFont(_font *f) {
+	free(f->glyphs);
+	free(f->ranges);
+	free(f->kerns);
+	free(f->direct);
+}
+
+// Reads the tables of a proportional font of size bytes into f, false
+// when it points outside them or out of memory.
+static bool _parseFont(_font *f, const unsigned char *data, long size) {
+	int n = _le16(data + 10), nr = _le16(data + 12), nk = _le16(data + 14);
+	long tables = FONT_HEADER + n * 8L + nr * 8L + nk * 6L;
+	const unsigned char *p = data + FONT_HEADER;
+
+	if (size<tables || n==0 || data[8]==0 || data[9]>data[8]) {
+		fprintf(stderr,"RTFT Error 27: invalid font file.\n");
+		return false;
+	}
+	f->y_size = data[8];
+	f->ascent = data[9];
+	f->glyph_count = n;
+	f->range_count = nr;
+	f->glyphs = (_font_glyph*)calloc(n, sizeof(_font_glyph));
+	f->ranges = (_font_range*)malloc(nr * sizeof(_font_range) + 1);
+	f->kerns = (_font_kern*)malloc(nk * sizeof(_font_kern) + 1);
+	f->direct = (unsigned short*)calloc(FONT_DIRECT, sizeof(unsigned short));
+	if (!f->glyphs || !f->ranges || !f->kerns || !f->direct) {
+		fprintf(stderr,"RTFT Error 29: cannot allocate font tables.\n");
+		_freeFont(f);
+		return false;
+	}
+
+	bool ok = true;
+	for (int i=0; i<n; i++, p+=8) {
+		_font_glyph *g = &f->glyphs[i];
+		unsigned long offset = _le32(p);
+		g->width = p[4];
+		g->left = (signed char)p[5];
+		g->advance = p[6];
+		g->bits = data + offset;
+		if (g->width && (offset<(unsigned long)tables || 
+				offset + (g->width + 7) / 8 * f->y_size>(unsigned long)size))
+			ok = false;
+		if (g->advance>f->x_size)
+			f->x_size = g->advance;
+	}
+	unsigned long next = 0;
+	for (int i=0; i<nr; i++, p+=8) {
+		_font_range *r = &f->ranges[i];
+		r->first = _le32(p);
+		r->count = _le16(p + 4);
+		r->glyph = _le16(p + 6);
+		if (r->first<next || r->first>0x10FFFF || r->count==0 || 
+				r->count>0x110000 - r->first || r->glyph + r->count>n) {
+			ok = false;
+			break;
+		}
+		next = r->first + r->count;
+		for (unsigned int c=r->first; c<next && c<FONT_DIRECT; c++)
+			f->direct[c] = r->glyph + c - r->first + 1;
+	}
+	int last = 0;
+	for (int i=0; i<nk && ok; i++, p+=6) {
+		int left = _le16(p);
+		f->kerns[i].right = _le16(p + 2);
+		f->kerns[i].adjust = (short)_le16(p + 4);
+		if (left<last || left>=n || f->kerns[i].right>=n) {
+			ok = false;
+			break;
+		}
+		if (!f->glyphs[left].kerns)
+			f->glyphs[left].kern = i;
+		f->glyphs[left].kerns++;
+		last = left;
+	}
+	if (!ok) {
+		fprintf(stderr,"RTFT Error 27: invalid font file.\n");
+		_freeFont(f);
+	}
+	return ok;
+}
+
+// NULL when a proportional font does not parse.
+static const _font* _addFont(const char *name, const unsigned char *data, long size, 
+bool mapped, const _span_font *spans) {
+	_font *f = &font_registry[font_count];
+	memset(f, 0, sizeof(_font));
+	strncpy(f->name, name, FONT_NAME - 1);
+	f->data = data;
+	f->size = size;
+	f->mapped = mapped;
+	f->spans = spans;
+	if (!data[0]) {
+		if (!_parseFont(f, data, size))
+			return NULL;
+	} else {
+		f->x_size = data[0];
+		f->y_size = data[1];
+		f->offset = data[2];
+		f->numchars = data[3];
+	}
+	font_count++;
+	return f;
+}
+
+// With font_lock held.
+static const _font* _lookupFont(const char *name, const unsigned char *data=NULL) {
+	if (!font_count) {
+		_addFont("SmallFont", SmallFont, sizeof(SmallFont), false, &small_spans);
+		_addFont("BigFont", BigFont, sizeof(BigFont), false, &big_spans);
+		_addFont("SevenSegNumFont", SevenSegNumFont, sizeof(SevenSegNumFont), false, 
+			&sevenseg_spans);
+	}
+	for (int i=0; i<font_count; i++)
+		if (data ? font_registry[i].data==data : 
+				!strncmp(font_registry[i].name, name, FONT_NAME - 1))
+			return &font_registry[i];
+	return NULL;
+}
+
+// The registry entry of a font array. Proportional fonts are 
+// registered without a name the first time.
+static const _font* _fontEntry(const unsigned char *data) {
+	pthread_mutex_lock(&font_lock);
+	const _font *f = _lookupFont(NULL, data);
+	if (!f && !memcmp(data, FONT_MAGIC, 4)) {
+		if (font_count==MAX_FONTS)
+			fprintf(stderr,"RTFT Error 28: too many fonts.\n");
+		else if (_fontSize(data))
+			f = _addFont("", data, _fontSize(data), false, NULL);
+		else
+			fprintf(stderr,"RTFT Error 27: invalid font file.\n");
+	}
+	pthread_mutex_unlock(&font_lock);
+	return f;
+}
+
+const _font* RTFT::findFont(const char *name) {
+	pthread_mutex_lock(&font_lock);
+	const _font *f = _lookupFont(name);
+	pthread_mutex_unlock(&font_lock);
+	return f;
+}
+
+// Registers a font array, with the span tables RTFT_SPAN_FONT made of
+// it. The size of a UTFT font is not known, so only its header is 
+// checked.
+const _font* RTFT::registerFont(const char *name, const unsigned char *font, 
+const _span_font *spans) {
+	if (!_fontSize(font) || (spans && spans->font!=font)) {
+		fprintf(stderr,"RTFT Error 27: invalid font file.\n");
+		return NULL;
+	}
+	pthread_mutex_lock(&font_lock);
+	const _font *f = _lookupFont(name);
+	if (!f) {
+		if (font_count==MAX_FONTS)
+			fprintf(stderr,"RTFT Error 28: too many fonts.\n");
+		else if (!spans || font[0])
+			f = _addFont(name, font, _fontSize(font), false, spans);
+		else
+			fprintf(stderr,"RTFT Error 27: invalid font file.\n");
+	}
+	pthread_mutex_unlock(&font_lock);
+	return f;
+}
+
+// Maps a font file and registers it as name, by default the file name
+// without directory and extension. A name already registered gives 
+// that font without loading the file.
+const _font* RTFT::loadFont(const char *path, const char *name) {
+	char base[FONT_NAME];
+	struct stat st;
+
+	if (!name) {
+		const char *p = strrchr(path, '/');
+		p = p ? p + 1 : path;
+		int n = strcspn(p, ".");
+		if (n>FONT_NAME - 1)
+			n = FONT_NAME - 1;
+		memcpy(base, p, n);
+		base[n] = 0;
+		name = base;
+	}
+
+	pthread_mutex_lock(&font_lock);
+	const _font *f = _lookupFont(name);
+	if (f) {
+		pthread_mutex_unlock(&font_lock);
+		return f;
+	}
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	void *data = MAP_FAILED;
+	if (fd>=0 && !fstat(fd, &st) && st.st_size>=4)
+		data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (fd>=0)
+		close(fd);
+	if (data==MAP_FAILED) {
+		if (fd<0)
+			fprintf(stderr,"RTFT Error 26: cannot open font file.\n");
+		else
+			fprintf(stderr,"RTFT Error 27: invalid font file.\n");
+	} else if (!_fontSize((const unsigned char*)data) || 
+			_fontSize((const unsigned char*)data)>st.st_size) {
+		fprintf(stderr,"RTFT Error 27: invalid font file.\n");
+		munmap(data, st.st_size);
+	} else if (font_count==MAX_FONTS) {
+		fprintf(stderr,"RTFT Error 28: too many fonts.\n");
+		munmap(data, st.st_size);
+	} else {
+		f = _addFont(name, (const unsigned char*)data, st.st_size, true, NULL);
+		if (!f)
+			munmap(data, st.st_size);
+	}
+	pthread_mutex_unlock(&font_lock);
+	return f;
+}
+
+void RTFT::setFont(const unsigned char* font, bool t)
+{
+	if (font==cfont.font) {
+		_transparent = t;
+		return;
+	}
+	const _font *f = _fontEntry(font);
+	if (f || !font[0]) {
+		setFont(f, t);
+		return;
+	}
+	cfont.spans = NULL;
+	cfont.prop = NULL;
+	cfont.font=font;
+	cfont.x_size=fontbyte(0);
+	cfont.y_size=fontbyte(1);
+	cfont.offset=fontbyte(2);
+	cfont.numchars=fontbyte(3);
+
+	_transparent = t;
+}
+
+void RTFT::setFont(const _font *font, bool t) {
+	if (!font)
+		return;
+	cfont.font = font->data;
+	cfont.x_size = font->x_size;
+	cfont.y_size = font->y_size;
+	cfont.offset = font->offset;
+	cfont.numchars = font->numchars;
+	cfont.spans = font->spans;
+	cfont.prop = font->glyphs ? font : NULL;
+
+	_transparent = t;
+}
+
+const unsigned char* RTFT::getFont() {
+	return cfont.font;
+}
+
+unsigned char RTFT::getFontXsize() {
+	return cfont.x_size;
+}
+
+unsigned char RTFT::getFontYsize() {
+	return cfont.y_size;
+}
+
+void RTFT::drawBitmap(unsigned short int x, unsigned short int y, 
+unsigned short int sx, unsigned short int sy, bitmapdatatype data) {
+	drawBitmap(x, y, sx, sy, data, (unsigned int)sx);
+}
+
+// Draws an sx by sy part of a larger bitmap, rows of the source are 
+// stride pixels apart.
+void RTFT::drawBitmap(unsigned short int x, unsigned short int y, 
+unsigned short int sx, unsigned short int sy, bitmapdatatype data, 
+unsigned int stride) {
+	STAT_PROBE(STAT_DRAWBITMAP);
+	if (recording) {
+		_command *cmd = _record(STAT_DRAWBITMAP, x, y, x + sx - 1, y + sy - 1);
+		_args(cmd, x, y, sx, sy, stride);
+		if (cmd)
+			cmd->data = data;
+		return;
+	}
+	int dx1 = x + clip.ox, dy1 = y + clip.oy;
+	int dx2 = dx1 + sx - 1, dy2 = dy1 + sy - 1;
+
+	if (sx==0 || sy==0 || !_clipRect(dx1, dy1, dx2, dy2))
+		return;
+	_addDamage(dx1, dy1, dx2, dy2);
+
+	// copy the visible part of each row
+	const unsigned short *src = data + (long)(dy1 - (y + clip.oy)) * stride + (dx1 - (x + clip.ox));
+	char *line = wbp + dy1 * surface.stride + dx1 * bypp;
+	STAT_PIXELS((dx2 - dx1 + 1) * (dy2 - dy1 + 1));
+	if (alpha_w<256)
+		_blendRows(line, src, stride, NULL, 0, dx2 - dx1 + 1, dy2 - dy1 + 1);
+	else if (bitmap_key==VGA_TRANSPARENT)
+		ops->bitmap(line, surface.stride, src, stride, dx2 - dx1 + 1, dy2 - dy1 + 1);
+	else
+		ops->bitmapKey(line, surface.stride, src, stride, dx2 - dx1 + 1, 
+			dy2 - dy1 + 1, bitmap_key);
+}
+
+// Copies the box (x1,y1)-(x2,y2) of the page being drawn on another 
+// display, or on this one, to (x,y). The color key applies as for 
+// bitmaps.
+void RTFT::drawBitmap(unsigned short int x, unsigned short int y, RTFT &src, 
+unsigned short int x1, unsigned short int y1, unsigned short int x2, 
+unsigned short int y2) {
+	STAT_PROBE(STAT_COPYBITMAP);
+	if (x1>x2) swap(unsigned short int, x1, x2);
+	if (y1>y2) swap(unsigned short int, y1, y2);
+	if (recording) {
+		_command *cmd = _record(STAT_COPYBITMAP, x, y, x + x2 - x1, y + y2 - y1);
+		_args(cmd, x, y, x1, y1, x2, y2);
+		if (cmd)
+			cmd->data = &src;
+		return;
+	}
+	if (x2>=src.surface.width) x2 = src.surface.width - 1;
+	if (y2>=src.surface.height) y2 = src.surface.height - 1;
+	if (x1>x2 || y1>y2)
+		return;
+	int dx1 = x + clip.ox, dy1 = y + clip.oy;
+	int dx2 = dx1 + x2 - x1, dy2 = dy1 + y2 - y1;
+
+	if (!_clipRect(dx1, dy1, dx2, dy2))
+		return;
+	_addDamage(dx1, dy1, dx2, dy2);
+
+	int w = dx2 - dx1 + 1, h = dy2 - dy1 + 1;
+	int stride = surface.stride, sstride = src.surface.stride;
+	STAT_PIXELS(w * h);
+	char *line = wbp + dy1 * stride + dx1 * bypp;
+	const char *sline = src.wbp + (y1 + dy1 - (y + clip.oy)) * sstride + 
+		(x1 + dx1 - (x + clip.ox)) * src.bypp;
+	if (sline < line && sline + (long)h * sstride > line) {
+		// overlapping copy downwards, go bottom up
+		line += (h - 1) * stride;
+		sline += (h - 1) * sstride;
+		stride = -stride;
+		sstride = -sstride;
+	}
+
+	if (alpha_w<256) {
+		// through RGB565, a piece of a row at a time
+		unsigned short buf[256];
+		for (int row=0; row<h; row++, line+=stride, sline+=sstride)
+			for (int col=0; col<w; col+=256) {
+				int n = w - col < 256 ? w - col : 256;
+				for (int i=0; i<n; i++)
+					buf[i] = src.ops->load(sline + (col + i) * src.bypp);
+				_blendRows(line + col * bypp, buf, n, NULL, 0, n, 1);
+			}
+	} else if (src.ops!=ops) {
+		for (int row=0; row<h; row++, line+=stride, sline+=sstride) {
+			char *p = line;
+			const char *q = sline;
+			for (int col=0; col<w; col++, p+=bypp, q+=src.bypp) {
+				unsigned short c = src.ops->load(q);
+				if (c!=bitmap_key)
+					ops->pixel(p, ops->convert(c));
+			}
+		}
+	} else if (bitmap_key!=VGA_TRANSPARENT)
+		ops->copyKey(line, stride, sline, sstride, w, h, ops->convert(bitmap_key));
+	else
+		for (int row=0; row<h; row++, line+=stride, sline+=sstride)
+			memmove(line, sline, w * bypp);
+}
+
+// Bitmap pixels of this color are not drawn, VGA_TRANSPARENT draws all.
+void RTFT::setColorKey(unsigned int color) {
+	bitmap_key = color;
+}
+
+unsigned int RTFT::getColorKey() {
+	return bitmap_key;
+}
+
+// Opacity of everything drawn from now on, 255 draws opaque.
+void RTFT::setAlpha(unsigned char a) {
+	alpha = a;
+	alpha_w = a + (a >> 7);
+}
+
+unsigned char RTFT::getAlpha() {
+	return alpha;
+}
+
+// Blends h rows of w RGB565 pixels at the current alpha, scaled by 
+// mask when given. Pixels equal to the color key are left alone.
+void RTFT::_blendRows(char *line, const unsigned short *src, int sstride, 
+const unsigned char *mask, int mstride, int w, int h) {
+	unsigned char keep[256];
+
+	for (int row=0; row<h; row++, line+=surface.stride, src+=sstride) {
+		if (bitmap_key==VGA_TRANSPARENT)
+			ops->blend(line, w, src, 0, mask, alpha_w);
+		else
+			for (int col=0; col<w; col+=256) {
+				int n = w - col < 256 ? w - col : 256;
+				for (int i=0; i<n; i++)
+					keep[i] = src[col + i]==bitmap_key ? 0 : mask ? mask[col + i] : 255;
+				ops->blend(line + col * bypp, n, src + col, 0, keep, alpha_w);
+			}
+		if (mask)
+			mask += mstride;
+	}
+}
+
+// Blends the current color through an sx by sy mask of 8 bit 
+// coverage values, as from an anti-aliased glyph or a gradient.
+void RTFT::fillMask(unsigned short int x, unsigned short int y, 
+unsigned short int sx, unsigned short int sy, const unsigned char *mask) {
+	STAT_PROBE(STAT_FILLMASK);
+	if (recording) {
+		_command *cmd = _record(STAT_FILLMASK, x, y, x + sx - 1, y + sy - 1);
+		_args(cmd, x, y, sx, sy);
+		if (cmd)
+			cmd->mask = mask;
+		return;
+	}
+	int dx1 = x + clip.ox, dy1 = y + clip.oy;
+	int dx2 = dx1 + sx - 1, dy2 = dy1 + sy - 1;
+
+	if (sx==0 || sy==0 || !_clipRect(dx1, dy1, dx2, dy2))
+		return;
+	_addDamage(dx1, dy1, dx2, dy2);
+
+	const unsigned char *m = mask + (long)(dy1 - (y + clip.oy)) * sx + (dx1 - (x + clip.ox));
+	char *line = wbp + dy1 * surface.stride + dx1 * bypp;
+	STAT_PIXELS((dx2 - dx1 + 1) * (dy2 - dy1 + 1));
+	for (int row=dy1; row<=dy2; row++, m+=sx, line+=surface.stride)
+		ops->blend(line, dx2 - dx1 + 1, NULL, native_color, m, alpha_w);
+}
+
+// Draws a bitmap with an 8 bit alpha value for every pixel.
+void RTFT::drawBitmapMask(unsigned short int x, unsigned short int y, 
+unsigned short int sx, unsigned short int sy, bitmapdatatype data, 
+const unsigned char *mask) {
+	STAT_PROBE(STAT_DRAWBITMAPMASK);
+	if (recording) {
+		_command *cmd = _record(STAT_DRAWBITMAPMASK, x, y, x + sx - 1, y + sy - 1);
+		_args(cmd, x, y, sx, sy);
+		if (cmd) {
+			cmd->data = data;
+			cmd->mask = mask;
+		}
+		return;
+	}
+	int dx1 = x + clip.ox, dy1 = y + clip.oy;
+	int dx2 = dx1 + sx - 1, dy2 = dy1 + sy - 1;
+
+	if (sx==0 || sy==0 || !_clipRect(dx1, dy1, dx2, dy2))
+		return;
+	_addDamage(dx1, dy1, dx2, dy2);
+
+	long ofs = (long)(dy1 - (y + clip.oy)) * sx + (dx1 - (x + clip.ox));
+	char *line = wbp + dy1 * surface.stride + dx1 * bypp;
+	STAT_PIXELS((dx2 - dx1 + 1) * (dy2 - dy1 + 1));
+	_blendRows(line, data + ofs, sx, mask + ofs, sx, dx2 - dx1 + 1, dy2 - dy1 + 1);
+}
+
+void RTFT::drawBitmap(unsigned short int x, unsigned short int y, 
+unsigned short int sx, unsigned short int sy, bitmapdatatype data, unsigned short int deg, unsigned short int rox, unsigned short int roy) {
+	STAT_PROBE(STAT_ROTATEBITMAP);
+	_affine a;
+
+	if (deg%360==0) {
+		drawBitmap(x, y, sx, sy, data);
+		return;
+	}
+	if (sx==0 || sy==0)
+		return;
+	if (recording) {
+		_affineSetup(a, x + rox, y + roy, -rox, -roy, sx - 1 - rox, sy - 1 - roy, deg);
+		_command *cmd = _record(STAT_ROTATEBITMAP, a.x1, a.y1, a.x2, a.y2);
+		_args(cmd, x, y, sx, sy, rox, roy);
+		if (cmd) {
+			cmd->param = deg;
+			cmd->data = data;
+		}
+		return;
+	}
+	_affineSetup(a, x + rox + clip.ox, y + roy + clip.oy, -rox, -roy, 
+		sx - 1 - rox, sy - 1 - roy, deg);
+	int bx1 = a.x1, by1 = a.y1, bx2 = a.x2, by2 = a.y2;
+	if (!_clipRect(bx1, by1, bx2, by2))
+		return;
+	_addDamage(bx1, by1, bx2, by2);
+
+	// quarter turns step through the source by whole pixels
+	bool quarter = deg%90==0;
+	int step = (a.c >> 16) - (a.s >> 16) * sx;
+
+	for (int py=by1; py<=by2; py++) {
+		int x1 = bx1, x2 = bx2, u, v;
+		if (!_affineRow(a, py, x1, x2, u, v))
+			continue;
+		char *p = wbp + py * surface.stride + x1 * bypp;
+		STAT_PIXELS(x2 - x1 + 1);
+		// bitmap coordinates, pixel centres on whole numbers
+		u += rox << 16;
+		v += roy << 16;
+		if (quarter) {
+			const unsigned short *src = data + (long)((v + 0x8000) >> 16) * sx + 
+				((u + 0x8000) >> 16);
+			for (int px=x1; px<=x2; px++, p+=bypp, src+=step)
+				if (*src!=bitmap_key)
+					_store(p, ops->convert(*src));
+		} else if (rotate_filter==ROTATE_BILINEAR) {
+			for (int px=x1; px<=x2; px++, p+=bypp, u+=a.c, v-=a.s) {
+				if (data[((v + 0x8000) >> 16) * sx + ((u + 0x8000) >> 16)]==bitmap_key)
+					continue;
+				int c0 = u >> 16, r0 = v >> 16, c1 = c0 + 1, r1 = r0 + 1;
+				if (c0<0) c0 = 0;
+				if (r0<0) r0 = 0;
+				if (c1>=sx) c1 = sx - 1;
+				if (r1>=sy) r1 = sy - 1;
+				int wx = (u >> 8) & 0xFF, wy = (v >> 8) & 0xFF;
+				unsigned short top = _mix565(data[r0*sx + c0], data[r0*sx + c1], wx);
+				unsigned short bottom = _mix565(data[r1*sx + c0], data[r1*sx + c1], wx);
+				_store(p, ops->convert(_mix565(top, bottom, wy)));
+			}
+		} else {
+			u += 0x8000;
+			v += 0x8000;
+			for (int px=x1; px<=x2; px++, p+=bypp, u+=a.c, v-=a.s) {
+				unsigned short col = data[(v >> 16) * sx + (u >> 16)];
+				if (col!=bitmap_key)
+					_store(p, ops->convert(col));
+			}
+		}
+	}
+}
+
+void RTFT::setRotateFilter(unsigned char filter) {
+	rotate_filter = filter;
+}
+
+// Clip rectangles and viewports are given in the coordinates of the 
+// current viewport and always shrink the current clip rectangle.
+void RTFT::pushClip(unsigned short int x1, unsigned short int y1, 
+unsigned short int x2, unsigned short int y2) {
+	_pushClip(x1, y1, x2, y2, false);
+}
+
+void RTFT::pushViewport(unsigned short int x1, unsigned short int y1, 
+unsigned short int x2, unsigned short int y2) {
+	_pushClip(x1, y1, x2, y2, true);
+}
+
+void RTFT::_pushClip(int x1, int y1, int x2, int y2, bool origin) {
+	if (clip_depth>=MAX_CLIP) {
+		fprintf(stderr,"RTFT Error 09: clip stack overflow.\n");
+		clip_overflow++;
+		return;
+	}
+	clip_stack[clip_depth++] = clip;
+
+	if (x1>x2) swap(int, x1, x2);
+	if (y1>y2) swap(int, y1, y2);
+	x1 += clip.ox; x2 += clip.ox;
+	y1 += clip.oy; y2 += clip.oy;
+	if (origin) {
+		clip.ox = x1;
+		clip.oy = y1;
+		clip.w = x2 - x1 + 1;
+		clip.h = y2 - y1 + 1;
+	}
+	if (x1>clip.x1) clip.x1 = x1;
+	if (y1>clip.y1) clip.y1 = y1;
+	if (x2<clip.x2) clip.x2 = x2;
+	if (y2<clip.y2) clip.y2 = y2;
+}
+
+void RTFT::popClip() {
+	if (clip_overflow) {
+		clip_overflow--;
+		return;
+	}
+	if (clip_depth>0)
+		clip = clip_stack[--clip_depth];
+}
+
+void RTFT::popViewport() {
+	popClip();
+}
+
+void RTFT::resetClip() {
+	clip.x1 = 0;
+	clip.y1 = 0;
+	clip.x2 = surface.width - 1;
+	clip.y2 = surface.height - 1;
+	clip.ox = 0;
+	clip.oy = 0;
+	clip.w = surface.width;
+	clip.h = surface.height;
+	clip_depth = 0;
+	clip_overflow = 0;
+}
+
+const _clip* RTFT::getClip() {
+	return &clip;
+}
+
+int RTFT::getDisplayXSize() {
+		return surface.width;
+}
+
+int RTFT::getDisplayYSize() {
+		return surface.height;
+}
+
+void RTFT::setDisplayPage(unsigned char page) {
+	if (page>=pages)
+		return;
+
+	if (surface.type==SURFACE_FBDEV) {
+		vinfo.xoffset = 0;
+		vinfo.yoffset = page * vinfo.yres;
+		if (ioctl(fbfd, FBIOPAN_DISPLAY, &vinfo)) {
+			fprintf(stderr,"RTFT Error 08: panning display.\n");
+			return;
+		}
+	}
+	display_page = page;
+}
+
+void RTFT::setWritePage(unsigned char page) {
+	if (backbuf) {
+		wbp = backbuf;
+		return;
+	}
+	if (page>=pages)
+		return;
+
+	write_page = page;
+	wbp = fbp + page * pagesize;
+}
+
+unsigned char RTFT::getDisplayPage() {
+	return display_page;
+}
+
+unsigned char RTFT::getWritePage() {
+	return write_page;
+}
+
+unsigned char RTFT::getPageCount() {
+	return backbuf ? 2 : pages;
+}
+
+// Shows the page just drawn and moves drawing to the next one. With a
+// heap back buffer only the damaged areas are copied to the screen.
+// When a frame rate is set the call returns at the frame deadline.
+void RTFT::present() {
+	STAT_PROBE(STAT_PRESENT);
+	long long start = _clock();
+	bool missed = frame_ns && start > frame_deadline;
+
+	if (page_shadow) {
+		// the damage of the flipped page is all that reads video memory
+		char *shadow = page_shadow + write_page * pagesize;
+		for (int i=0; i<damage_count; i++) {
+			long int offset = damage[i].y1 * surface.stride + damage[i].x1 * bypp;
+			int len = (damage[i].x2 - damage[i].x1 + 1) * bypp;
+			for (int y=damage[i].y1; y<=damage[i].y2; y++) {
+				memcpy(shadow + offset, wbp + offset, len);
+				offset += surface.stride;
+			}
+		}
+	}
+	if (capture)
+		_captureFrame();
+	if (server)
+		_serveFrame();
+	if (backbuf) {
+		_waitFrame();
+		for (int i=0; i<damage_count; i++) {
+			long int offset = damage[i].y1 * surface.stride + damage[i].x1 * bypp;
+			int len = (damage[i].x2 - damage[i].x1 + 1) * bypp;
+			STAT_PIXELS((damage[i].x2 - damage[i].x1 + 1) * (damage[i].y2 - damage[i].y1 + 1));
+			for (int y=damage[i].y1; y<=damage[i].y2; y++) {
+				memcpy(fbp + offset, backbuf + offset, len);
+				offset += surface.stride;
+			}
+		}
+	} else if (pages>1) {
+		setDisplayPage(write_page);
+		setWritePage((write_page + 1) % pages);
+		// the old page is scanned out until the pan is latched
+		_waitFrame();
+	} else {
+		_waitFrame();
+	}
+	damage_count = 0;
+
+	long long end = _clock();
+	_frame_stats *st = &frame_stats[frame_count % FRAME_HISTORY];
+	st->render_us = (start - frame_end) / 1000;
+	st->present_us = (end - start) / 1000;
+	st->interval_us = (end - frame_end) / 1000;
+	st->missed = missed;
+	frame_count++;
+	if (missed)
+		missed_frames++;
+	frame_end = end;
+	if (frame_ns)
+		frame_deadline = (missed ? end : frame_deadline) + frame_ns;
+#ifdef RTFT_STATS
+	if (stat_every && frame_count % stat_every==0)
+		dumpStats();
+#endif
+}
+
+void RTFT::_waitFrame() {
+	if (vsync && vsync_state>=0) {
+		int zero = 0;
+		do {
+			if (ioctl(fbfd, FBIO_WAITFORVSYNC, &zero)) {
+				// not supported by the driver, use the frame timer
+				vsync_state = -1;
+				break;
+			}
+			vsync_state = 1;
+		} while (frame_ns && _clock() + frame_ns/2 < frame_deadline);
+		if (vsync_state>0)
+			return;
+	}
+	if (frame_ns) {
+		struct timespec ts;
+		ts.tv_sec = frame_deadline / 1000000000LL;
+		ts.tv_nsec = frame_deadline % 1000000000LL;
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)==EINTR);
+	}
+}
+
+long long RTFT::_clock() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Drawing calls after beginList() are recorded in the list instead of
+// drawn, with the colors, font, color key and rotate filter in effect.
+// Clip and viewport calls are not recorded, the list is drawn with the
+// clip rectangle and viewport in effect when drawList() is called.
+void RTFT::beginList(RTFTList *list) {
+	list->clear();
+	recording = list;
+}
+
+void RTFT::endList() {
+	if (!recording)
+		return;
+	_sortList(recording);
+	recording = NULL;
+}
+
+_command* RTFT::_record(unsigned char op, int bx1, int by1, int bx2, int by2) {
+	RTFTList *l = recording;
+
+	if (l->count==l->size) {
+		int size = l->size ? l->size * 2 : 64;
+		_command *cmds = (_command*)realloc(l->cmds, size * sizeof(_command));
+		if (!cmds) {
+			fprintf(stderr,"RTFT Error 16: cannot grow display list.\n");
+			return NULL;
+		}
+		l->cmds = cmds;
+		l->size = size;
+	}
+	if (bx1>bx2) swap(int, bx1, bx2);
+	if (by1>by2) swap(int, by1, by2);
+
+	_command *c = &l->cmds[l->count++];
+	c->op = op;
+	c->flags = (_transparent ? CMD_TRANSPARENT : 0) | 
+		(rotate_filter==ROTATE_BILINEAR ? CMD_BILINEAR : 0);
+	c->color = current_color;
+	c->back = current_back_color;
+	c->param = 0;
+	c->key = bitmap_key;
+	c->alpha = alpha;
+	c->format = surface.format;
+	c->native = native_color;
+	c->native_back = native_back_color;
+	c->bx1 = bx1;
+	c->by1 = by1;
+	c->bx2 = bx2;
+	c->by2 = by2;
+	c->data = cfont.font;
+	c->mask = NULL;
+	return c;
+}
+
+// Groups the commands by type where that cannot change the picture: a
+// command only moves ahead of commands it does not overlap, and none 
+// moves across a copy from this display. Fills of the same state that 
+// end up next to each other and touch are merged.
+void RTFT::_sortList(RTFTList *list) {
+	int n = list->count, k = 0, first = 0;
+	_command *cmds = list->cmds;
+	_command *out = (_command*)malloc(n * sizeof(_command));
+	int *blockers = (int*)malloc(n * sizeof(int));
+	bool *done = (bool*)calloc(n, sizeof(bool));
+
+	if (n && (!out || !blockers || !done)) {
+		// not enough memory, keep the order as recorded
+		free(out);
+		free(blockers);
+		free(done);
+		return;
+	}
+	while (k<n) {
+		while (done[first])
+			first++;
+		unsigned char op = cmds[first].op;
+		int nb = 0;
+		for (int i=first; i<n; i++) {
+			if (done[i])
+				continue;
+			bool blocked = cmds[i].op!=op || (nb && _copiesFrom(cmds[i], this));
+			for (int j=0; j<nb && !blocked; j++)
+				blocked = _overlap(cmds[blockers[j]], cmds[i]) || 
+					_copiesFrom(cmds[blockers[j]], this);
+			if (blocked)
+				blockers[nb++] = i;
+			else {
+				out[k++] = cmds[i];
+				done[i] = true;
+			}
+		}
+	}
+
+	k = 0;
+	for (int i=0; i<n; i++) {
+		_command *c = &out[i];
+		if (k>0 && c->op==STAT_FILLRECT) {
+			_command *p = &cmds[k-1];
+			if (p->op==STAT_FILLRECT && _sameState(*p, *c) && 
+					((p->bx1==c->bx1 && p->bx2==c->bx2 && 
+					(p->by2+1==c->by1 || c->by2+1==p->by1)) || 
+					(p->by1==c->by1 && p->by2==c->by2 && 
+					(p->bx2+1==c->bx1 || c->bx2+1==p->bx1)))) {
+				if (c->bx1<p->bx1) p->bx1 = c->bx1;
+				if (c->by1<p->by1) p->by1 = c->by1;
+				if (c->bx2>p->bx2) p->bx2 = c->bx2;
+				if (c->by2>p->by2) p->by2 = c->by2;
+				_args(p, p->bx1, p->by1, p->bx2, p->by2);
+				continue;
+			}
+		}
+		cmds[k++] = *c;
+	}
+	list->count = k;
+	free(out);
+	free(blockers);
+	free(done);
+}
+
+// Draws the commands of a list. Commands entirely outside the clip
+// rectangle are skipped. Colors, font and bitmap state are restored 
+// afterwards. With worker threads the list is drawn by tiles.
+void RTFT::drawList(RTFTList *list) {
+	if (pool && !recording && _drawTiles(list))
+		return;
+
+	unsigned short color = current_color, back = current_back_color;
+	unsigned int native = native_color, native_back = native_back_color;
+	const unsigned char *font = cfont.font;
+	bool transparent = _transparent;
+	unsigned int key = bitmap_key;
+	unsigned char filter = rotate_filter;
+	unsigned char a = alpha;
+
+	for (int i=0; i<list->count; i++) {
+		const _command *c = &list->cmds[i];
+		if (!recording && (c->bx2 + clip.ox < clip.x1 || c->bx1 + clip.ox > clip.x2 || 
+				c->by2 + clip.oy < clip.y1 || c->by1 + clip.oy > clip.y2))
+			continue;
+		_drawCommand(c);
+	}
+
+	current_color = color;
+	native_color = native;
+	current_back_color = back;
+	native_back_color = native_back;
+	if (font)
+		setFont(font, transparent);
+	_transparent = transparent;
+	bitmap_key = key;
+	rotate_filter = filter;
+	setAlpha(a);
+}
+
+void RTFT::_drawCommand(const _command *c) {
+	const int *a = c->a;
+
+	if (c->format==surface.format) {
+		current_color = c->color;
+		native_color = c->native;
+		current_back_color = c->back;
+		native_back_color = c->native_back;
+	} else {
+		// recorded for other pixels, the RGB565 colors are what is left
+		if (c->color!=current_color)
+			setColor(c->color);
+		if (c->back!=current_back_color)
+			setBackColor(c->back);
+	}
+	bitmap_key = c->key;
+	rotate_filter = c->flags & CMD_BILINEAR ? ROTATE_BILINEAR : ROTATE_NEAREST;
+	if (c->alpha!=alpha)
+		setAlpha(c->alpha);
+
+	switch (c->op) {
+	case STAT_DRAWRECT:
+		drawRect(a[0], a[1], a[2], a[3]);
+		break;
+	case STAT_DRAWROUNDRECT:
+		drawRoundRect(a[0], a[1], a[2], a[3], a[4]);
+		break;
+	case STAT_FILLRECT:
+		fillRect(a[0], a[1], a[2], a[3]);
+		break;
+	case STAT_FILLROUNDRECT:
+		fillRoundRect(a[0], a[1], a[2], a[3], a[4]);
+		break;
+	case STAT_DRAWCIRCLE:
+		drawCircle(a[0], a[1], a[2]);
+		break;
+	case STAT_FILLCIRCLE:
+		fillCircle(a[0], a[1], a[2]);
+		break;
+	case STAT_FILLSCR:
+		fillScr((unsigned short int)a[0]);
+		break;
+	case STAT_DRAWPIXEL:
+		drawPixel(a[0], a[1], a[2]);
+		break;
+	case STAT_DRAWLINE:
+		drawLine(a[0], a[1], a[2], a[3]);
+		break;
+	case STAT_DRAWHLINE:
+		drawHLine(a[0], a[1], a[2]);
+		break;
+	case STAT_DRAWVLINE:
+		drawVLine(a[0], a[1], a[2]);
+		break;
+	case STAT_PRINTCHAR:
+	case STAT_ROTATECHAR:
+		if (c->data!=cfont.font || (bool)(c->flags & CMD_TRANSPARENT)!=_transparent)
+			setFont((const unsigned char*)c->data, c->flags & CMD_TRANSPARENT);
+		if (c->op==STAT_PRINTCHAR)
+			_drawGlyph(c->param, a[0], a[1]);
+		else
+			_rotateGlyph(c->param, a[0], a[1], a[2], a[3]);
+		break;
+	case STAT_DRAWBITMAP:
+		drawBitmap(a[0], a[1], a[2], a[3], (bitmapdatatype)c->data, (unsigned int)a[4]);
+		break;
+	case STAT_ROTATEBITMAP:
+		drawBitmap(a[0], a[1], a[2], a[3], (bitmapdatatype)c->data, c->param, a[4], a[5]);
+		break;
+	case STAT_COPYBITMAP:
+		drawBitmap(a[0], a[1], *(RTFT*)c->data, a[2], a[3], a[4], a[5]);
+		break;
+	case STAT_FILLMASK:
+		fillMask(a[0], a[1], a[2], a[3], c->mask);
+		break;
+	case STAT_DRAWBITMAPMASK:
+		drawBitmapMask(a[0], a[1], a[2], a[3], (bitmapdatatype)c->data, c->mask);
+		break;
+	case STAT_DRAWLINEAA:
+		drawLineAA(a[0], a[1], a[2], a[3]);
+		break;
+	case STAT_DRAWARCAA:
+		drawArcAA(a[0], a[1], a[2], a[3], a[4]);
+		break;
+	case STAT_FILLTRIANGLE:
+		fillTriangle(a[0], a[1], a[2], a[3], a[4], a[5]);
+		break;
+	case STAT_FILLPOLYGON:
+		fillPolygon((const _point*)c->data, a[0], a[1]);
+		break;
+	case STAT_FILLPIE:
+		fillPie(a[0], a[1], a[2], a[3], a[4]);
+		break;
+	case STAT_FILLARC:
+		fillArc(a[0], a[1], a[2], a[3], a[4], a[5]);
+		break;
+	case STAT_DRAWELLIPSE:
+		drawEllipse(a[0], a[1], a[2], a[3]);
+		break;
+	case STAT_FILLELLIPSE:
+		fillEllipse(a[0], a[1], a[2], a[3]);
+		break;
+	}
+}
+
+//*********************************
+// TILED RENDERING
+//*********************************
+// drawList() with worker threads sorts the commands into TILE_W by 
+// TILE_H tiles of the surface by their box. Every thread draws whole 
+// tiles through its own RTFT sharing the pixels of the display, clipped
+// to the tile, so the threads never write the same pixels and the 
+// result is the same as drawing the list in one go.
+
+// Worker 0 is the thread calling drawList(). range holds the tiles the
+// worker has left to draw, the first in the low and the end in the 
+// high 32 bits, idle workers steal the upper half of another's range.
+struct _worker {
+	struct _pool *pool;
+	RTFT *view;
+	pthread_t thread;
+	int index;
+	unsigned long long range;
+};
+
+struct _pool {
+	int count;
+	_worker workers[MAX_THREADS];
+	pthread_mutex_t lock;
+	pthread_cond_t start;
+	pthread_cond_t done;
+	unsigned long job;
+	int running;
+	bool stop;
+
+	// tile t draws cmds[index[first[t]]] .. cmds[index[first[t+1]-1]]
+	const _command *cmds;
+	int *first;
+	int *index;
+	int tiles;
+	int tiles_x;
+	int size;
+};
+
+static inline unsigned long long _range(unsigned int lo, unsigned int hi) {
+	return (unsigned long long)hi << 32 | lo;
+}
+
+static int _popTile(_worker *w) {
+	unsigned long long r = __atomic_load_n(&w->range, __ATOMIC_ACQUIRE);
+	for (;;) {
+		unsigned int lo = r, hi = r >> 32;
+		if (lo>=hi)
+			return -1;
+		if (__atomic_compare_exchange_n(&w->range, &r, _range(lo + 1, hi), 
+				false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			return lo;
+	}
+}
+
+// Moves the upper half of the tiles of another worker to w, whose own
+// range is empty and so left alone by other thieves.
+static bool _stealTiles(_worker *w, _worker *victim) {
+	unsigned long long r = __atomic_load_n(&victim->range, __ATOMIC_ACQUIRE);
+	for (;;) {
+		unsigned int lo = r, hi = r >> 32;
+		if (lo>=hi)
+			return false;
+		unsigned int mid = hi - (hi - lo + 1) / 2;
+		if (__atomic_compare_exchange_n(&victim->range, &r, _range(lo, mid), 
+				false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			__atomic_store_n(&w->range, _range(mid, hi), __ATOMIC_RELEASE);
+			return true;
+		}
+	}
+}
+
+void* RTFT::_workerMain(void *arg) {
+	_worker *w = (_worker*)arg;
+	_pool *p = w->pool;
+	unsigned long seen = 0;
+
+	pthread_mutex_lock(&p->lock);
+	for (;;) {
+		while (!p->stop && p->job==seen)
+			pthread_cond_wait(&p->start, &p->lock);
+		if (p->stop)
+			break;
+		seen = p->job;
+		pthread_mutex_unlock(&p->lock);
+		_runTiles(w);
+		pthread_mutex_lock(&p->lock);
+		if (--p->running==0)
+			pthread_cond_signal(&p->done);
+	}
+	pthread_mutex_unlock(&p->lock);
+	return NULL;
+}
+
+void RTFT::_runTiles(_worker *w) {
+	_pool *p = w->pool;
+
+	for (;;) {
+		int t = _popTile(w);
+		if (t<0) {
+			bool stolen = false;
+			for (int i=1; i<p->count && !stolen; i++)
+				stolen = _stealTiles(w, &p->workers[(w->index + i) % p->count]);
+			if (!stolen)
+				return;
+			continue;
+		}
+		if (p->first[t]<p->first[t+1])
+			w->view->_drawTile(p, t);
+	}
+}
+
+// Draws the commands binned to tile t, on a view whose clip and 
+// viewport are those of the display drawing the list.
+void RTFT::_drawTile(_pool *p, int t) {
+	int x1 = (t % p->tiles_x) * TILE_W, y1 = (t / p->tiles_x) * TILE_H;
+	int x2 = x1 + TILE_W - 1, y2 = y1 + TILE_H - 1;
+	_clip area = clip;
+
+	if (x2>=surface.width) x2 = surface.width - 1;
+	if (y2>=surface.height) y2 = surface.height - 1;
+	bool inside = _clipRect(x1, y1, x2, y2);
+	clip.x1 = x1;
+	clip.y1 = y1;
+	clip.x2 = x2;
+	clip.y2 = y2;
+	// the display drawing the list keeps the damage
+	damage_count = 0;
+
+	for (int i=p->first[t]; i<p->first[t+1]; i++) {
+		const _command *c = &p->cmds[p->index[i]];
+		if (c->op==STAT_FILLSCR) {
+			// fillScr ignores the clip rectangle, fill the whole tile
+			int fx1 = (t % p->tiles_x) * TILE_W, fy1 = (t / p->tiles_x) * TILE_H;
+			int fx2 = fx1 + TILE_W - 1, fy2 = fy1 + TILE_H - 1;
+			unsigned int native = ops->convert(c->a[0]);
+			int w = c->alpha + (c->alpha >> 7);
+			if (fx2>=surface.width) fx2 = surface.width - 1;
+			if (fy2>=surface.height) fy2 = surface.height - 1;
+			for (int y=fy1; y<=fy2; y++)
+				if (w<256)
+					ops->blend(wbp + y * surface.stride + fx1 * bypp, fx2 - fx1 + 1, NULL, 
+						native, NULL, w);
+				else
+					ops->fill(wbp + y * surface.stride + fx1 * bypp, fx2 - fx1 + 1, native);
+			STAT_PIXELS((fx2 - fx1 + 1) * (fy2 - fy1 + 1));
+		} else if (inside)
+			_drawCommand(c);
+	}
+	clip = area;
+}
+
+// Narrows the columns x1..x2 to those a line can touch between rows y1
+// and y2, long lines cross far fewer tiles than their box.
+static void _lineBand(const _command *c, int ox, int oy, int y1, int y2, 
+int &x1, int &x2) {
+	long long ax = c->a[0] + ox, ay = c->a[1] + oy;
+	long long bx = c->a[2] + ox, by = c->a[3] + oy;
+	if (ay==by)
+		return;
+	// the ideal line a row beyond the band, a column to spare and one 
+	// more for the second pixel of anti-aliased lines
+	int spare = c->op==STAT_DRAWLINEAA ? 2 : 1;
+	long long xa = ax + (y1 - 1 - ay) * (bx - ax) / (by - ay);
+	long long xb = ax + (y2 + 1 - ay) * (bx - ax) / (by - ay);
+	if (xa>xb) swap(long long, xa, xb);
+	if (xa - spare > x1) x1 = xa - spare;
+	if (xb + spare < x2) x2 = xb + spare;
+}
+
+// Bins the commands to the tiles they touch and draws the tiles on all
+// threads. False to draw the list on this thread, when it copies from
+// this display or memory is short.
+bool RTFT::_drawTiles(RTFTList *list) {
+	_pool *p = pool;
+	int tiles_x = (surface.width + TILE_W - 1) / TILE_W;
+	int tiles = tiles_x * ((surface.height + TILE_H - 1) / TILE_H);
+	int n = list->count, total = 0;
+
+	if (n==0)
+		return true;
+	for (int i=0; i<n; i++)
+		if (list->cmds[i].op==STAT_COPYBITMAP && list->cmds[i].data==this)
+			return false;
+	if (p->size<tiles) {
+		int *first = (int*)realloc(p->first, (tiles + 1) * sizeof(int));
+		if (!first)
+			return false;
+		p->first = first;
+		p->size = tiles;
+	}
+
+	// count the commands of each tile, then place them
+	memset(p->first, 0, (tiles + 1) * sizeof(int));
+	for (int pass=0; pass<2; pass++) {
+		if (pass==1) {
+			int *index = (int*)realloc(p->index, (total ? total : 1) * sizeof(int));
+			if (!index)
+				return false;
+			p->index = index;
+			for (int t=0, sum=0; t<=tiles; t++) {
+				int k = p->first[t];
+				p->first[t] = sum;
+				sum += k;
+			}
+		}
+		for (int i=0; i<n; i++) {
+			const _command *c = &list->cmds[i];
+			int x1 = 0, y1 = 0, x2 = surface.width - 1, y2 = surface.height - 1;
+			if (c->op!=STAT_FILLSCR) {
+				x1 = c->bx1 + clip.ox;
+				y1 = c->by1 + clip.oy;
+				x2 = c->bx2 + clip.ox;
+				y2 = c->by2 + clip.oy;
+				if (!_clipRect(x1, y1, x2, y2))
+					continue;
+			}
+			if (pass==1) {
+				if (c->op==STAT_FILLSCR)
+					damage_count = 0;
+				_addDamage(x1, y1, x2, y2);
+			}
+			for (int ty=y1/TILE_H; ty<=y2/TILE_H; ty++) {
+				int bx1 = x1, bx2 = x2;
+				if (c->op==STAT_DRAWLINE || c->op==STAT_DRAWLINEAA)
+					_lineBand(c, clip.ox, clip.oy, ty * TILE_H, ty * TILE_H + TILE_H - 1, 
+						bx1, bx2);
+				for (int tx=bx1/TILE_W; tx<=bx2/TILE_W && bx1<=bx2; tx++) {
+					int t = ty * tiles_x + tx;
+					if (pass==0) {
+						p->first[t]++;
+						total++;
+					} else
+						p->index[p->first[t]++] = i;
+				}
+			}
+		}
+	}
+	// placing moved every start to the next tile
+	memmove(p->first + 1, p->first, tiles * sizeof(int));
+	p->first[0] = 0;
+
+	p->cmds = list->cmds;
+	p->tiles = tiles;
+	p->tiles_x = tiles_x;
+	for (int i=0; i<p->count; i++) {
+		RTFT *v = p->workers[i].view;
+		v->wbp = wbp;
+		v->ops = ops;
+		v->bypp = bypp;
+		v->surface = surface;
+		v->clip = clip;
+		// the state _drawCommand() keeps when it is the same, converted
+		// for these pixels
+		v->current_color = current_color;
+		v->native_color = native_color;
+		v->current_back_color = current_back_color;
+		v->native_back_color = native_back_color;
+		v->alpha = alpha;
+		v->alpha_w = alpha_w;
+		unsigned int lo = (long long)tiles * i / p->count;
+		unsigned int hi = (long long)tiles * (i + 1) / p->count;
+		p->workers[i].range = _range(lo, hi);
+	}
+
+	pthread_mutex_lock(&p->lock);
+	p->job++;
+	p->running = p->count - 1;
+	pthread_cond_broadcast(&p->start);
+	pthread_mutex_unlock(&p->lock);
+	_runTiles(&p->workers[0]);
+	pthread_mutex_lock(&p->lock);
+	while (p->running>0)
+		pthread_cond_wait(&p->done, &p->lock);
+	pthread_mutex_unlock(&p->lock);
+
+#ifdef RTFT_STATS
+	for (int i=0; i<p->count; i++) {
+		RTFT *v = p->workers[i].view;
+		for (int id=0; id<STAT_COUNT; id++) {
+			prim_stats[id].calls += v->prim_stats[id].calls;
+			prim_stats[id].pixels += v->prim_stats[id].pixels;
+			prim_stats[id].bytes += v->prim_stats[id].bytes;
+			prim_stats[id].ns += v->prim_stats[id].ns;
+		}
+		v->resetPrimitiveStats();
+	}
+#endif
+	return true;
+}
+
+// Draws display lists on n threads, the calling one included. 1 turns
+// the workers off.
+bool RTFT::setThreads(unsigned char n) {
+	if (n>MAX_THREADS) n = MAX_THREADS;
+	if (pool) {
+		pthread_mutex_lock(&pool->lock);
+		pool->stop = true;
+		pthread_cond_broadcast(&pool->start);
+		pthread_mutex_unlock(&pool->lock);
+		for (int i=0; i<pool->count; i++) {
+			if (i>0)
+				pthread_join(pool->workers[i].thread, NULL);
+			delete pool->workers[i].view;
+		}
+		pthread_mutex_destroy(&pool->lock);
+		pthread_cond_destroy(&pool->start);
+		pthread_cond_destroy(&pool->done);
+		free(pool->first);
+		free(pool->index);
+		delete pool;
+		pool = NULL;
+	}
+	if (n<=1)
+		return true;
+
+	pool = new _pool();
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->start, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	for (int i=0; i<n; i++) {
+		_worker *w = &pool->workers[i];
+		w->pool = pool;
+		w->index = i;
+		w->view = new RTFT();
+		w->view->_initState();
+		w->view->surface.type = SURFACE_MEMORY;
+		pool->count = i + 1;
+		if (i>0 && pthread_create(&w->thread, NULL, _workerMain, w)) {
+			fprintf(stderr,"RTFT Error 17: cannot start render thread.\n");
+			delete w->view;
+			pool->count = i;
+			break;
+		}
+	}
+	return pool->count==n;
+}
+
+unsigned char RTFT::getThreads() {
+	return pool ? pool->count : 1;
+}
+
+void RTFT::setFrameRate(unsigned char fps) {
+	frame_ns = fps ? 1000000000LL / fps : 0;
+	frame_deadline = _clock() + frame_ns;
+}
+
+void RTFT::setVsync(bool enable) {
+	vsync = enable;
+}
+
+bool RTFT::getVsync() {
+	return vsync && vsync_state>=0;
+}
+
+unsigned long RTFT::getFrameCount() {
+	return frame_count;
+}
+
+unsigned long RTFT::getMissedFrames() {
+	return missed_frames;
+}
+
+// Stats of the frame presented 'ago' frames before the last one.
+bool RTFT::getFrameStats(unsigned char ago, _frame_stats *st) {
+	if (ago>=FRAME_HISTORY || ago>=frame_count)
+		return false;
+	*st = frame_stats[(frame_count - 1 - ago) % FRAME_HISTORY];
+	return true;
+}
+
+// Average frame rate over the frames kept in the history.
+float RTFT::getFps() {
+	unsigned long n = frame_count<FRAME_HISTORY ? frame_count : FRAME_HISTORY;
+	unsigned long long total = 0;
+
+	for (unsigned long i=0; i<n; i++)
+		total += frame_stats[i].interval_us;
+	if (total==0)
+		return 0;
+	return n * 1000000.0 / total;
+}
+
+bool RTFT::getPrimitiveStats(unsigned char id, _prim_stats *st) {
+#ifdef RTFT_STATS
+	if (id>=STAT_COUNT)
+		return false;
+	*st = prim_stats[id];
+	return true;
+#else
+	(void)id;
+	(void)st;
+	return false;
+#endif
+}
+
+void RTFT::resetPrimitiveStats() {
+#ifdef RTFT_STATS
+	memset(prim_stats, 0, sizeof(prim_stats));
+	for (int i=0; i<STAT_COUNT; i++)
+		strcpy(prim_stats[i].name, stat_names[i]);
+	stat_pixels = 0;
+#endif
+}
+
+// Dumps the counters every 'frames' presented frames, to stderr when
+// path is NULL or else into a shared file laid out as _stats_file. 
+// frames 0 stops the dumps.
+bool RTFT::setStatsDump(const char *path, unsigned int frames) {
+#ifdef RTFT_STATS
+	if (stat_file)
+		munmap(stat_file, sizeof(_stats_file));
+	if (stat_fd>=0)
+		close(stat_fd);
+	stat_file = NULL;
+	stat_fd = -1;
+	stat_every = frames;
+	if (!frames || !path)
+		return true;
+
+	stat_fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (stat_fd<0 || ftruncate(stat_fd, sizeof(_stats_file))) {
+		fprintf(stderr,"RTFT Error 15: cannot create stats file.\n");
+		stat_every = 0;
+		return false;
+	}
+	void *m = mmap(0, sizeof(_stats_file), PROT_READ | PROT_WRITE, MAP_SHARED, stat_fd, 0);
+	if (m == MAP_FAILED) {
+		fprintf(stderr,"RTFT Error 06: Failed to mmap.\n");
+		stat_every = 0;
+		return false;
+	}
+	stat_file = (_stats_file*)m;
+	stat_file->magic = STATS_MAGIC;
+	stat_file->count = STAT_COUNT;
+	return true;
+#else
+	(void)path;
+	return !frames;
+#endif
+}
+
+void RTFT::dumpStats() {
+#ifdef RTFT_STATS
+	if (stat_file) {
+		stat_file->seq++;
+		__sync_synchronize();
+		memcpy(stat_file->stats, prim_stats, sizeof(prim_stats));
+		stat_file->frame = frame_count;
+		__sync_synchronize();
+		stat_file->seq++;
+		return;
+	}
+	fprintf(stderr, "RTFT stats at frame %lu\n", frame_count);
+	for (int i=0; i<STAT_COUNT; i++) {
+		_prim_stats *st = &prim_stats[i];
+		if (st->calls)
+			fprintf(stderr, "  %-14s %10llu calls %12llu pixels %12llu bytes %10llu us\n", 
+				st->name, st->calls, st->pixels, st->bytes, st->ns / 1000);
+	}
+#endif
+}
+
+unsigned char RTFT::getPixelFormat() {
+	return ops->format;
+}
+
+const _surface* RTFT::getSurface() {
+	return &surface;
+}
+
+// Pixels of the page on display, or of the target of present() when
+// drawing into a back buffer.
+const char* RTFT::getPixels() {
+	return fbp + display_page * pagesize;
+}
+
+// Loads the RGB332 palette used by 8 bit indexed modes.
+void RTFT::_loadPalette() {
+	unsigned short r[256], g[256], b[256];
+	struct fb_cmap cmap;
+
+	for (int i=0; i<256; i++) {
+		r[i] = ((i >> 5) & 7) * 0xFFFF / 7;
+		g[i] = ((i >> 2) & 7) * 0xFFFF / 7;
+		b[i] = (i & 3) * 0xFFFF / 3;
+	}
+	cmap.start = 0;
+	cmap.len = 256;
+	cmap.red = r;
+	cmap.green = g;
+	cmap.blue = b;
+	cmap.transp = NULL;
+	if (ioctl(fbfd, FBIOPUTCMAP, &cmap))
+		fprintf(stderr,"RTFT Error 11: setting palette.\n");
+}
+
+const char* RTFT::getSpanKernel() {
+	return fill_name;
+}
+
+unsigned char RTFT::getDamageCount() {
+	return damage_count;
+}
+
+const _rect* RTFT::getDamage() {
+	return damage;
+}
+
+long int RTFT::getDamageArea() {
+	long int area = 0;
+	for (int i=0; i<damage_count; i++)
+		area += (long int)(damage[i].x2 - damage[i].x1 + 1) * 
+			(damage[i].y2 - damage[i].y1 + 1);
+	return area;
+}
+
+void RTFT::clearDamage() {
+	damage_count = 0;
+}
+
+// Adds a box to the damage region. Boxes that overlap or touch an 
+// existing one are merged into it, so the list stays short and never 
+// copies a pixel twice. When the list is full the box is merged with 
+// the entry that grows the least.
+void RTFT::_addDamage(int x1, int y1, int x2, int y2) {
+	if (x1>x2) swap(int, x1, x2);
+	if (y1>y2) swap(int, y1, y2);
+	if (!_clipRect(x1, y1, x2, y2))
+		return;
+
+	int i = 0;
+	while (i<damage_count) {
+		_rect *r = &damage[i];
+		if (x1>=r->x1 && x2<=r->x2 && y1>=r->y1 && y2<=r->y2)
+			return;
+		if (x1<=r->x2+1 && x2+1>=r->x1 && y1<=r->y2+1 && y2+1>=r->y1) {
+			if (r->x1<x1) x1 = r->x1;
+			if (r->y1<y1) y1 = r->y1;
+			if (r->x2>x2) x2 = r->x2;
+			if (r->y2>y2) y2 = r->y2;
+			damage[i] = damage[--damage_count];
+			i = 0;
+		} else
+			i++;
+	}
+
+	if (damage_count==MAX_DAMAGE) {
+		long int best_growth = -1;
+		int best = 0;
+		for (i=0; i<damage_count; i++) {
+			_rect *r = &damage[i];
+			long int ux1 = r->x1<x1 ? r->x1 : x1, uy1 = r->y1<y1 ? r->y1 : y1;
+			long int ux2 = r->x2>x2 ? r->x2 : x2, uy2 = r->y2>y2 ? r->y2 : y2;
+			long int growth = (ux2-ux1+1)*(uy2-uy1+1) - 
+				(long int)(r->x2-r->x1+1)*(r->y2-r->y1+1);
+			if (best_growth<0 || growth<best_growth) {
+				best_growth = growth;
+				best = i;
+			}
+		}
+		x1 = damage[best].x1<x1 ? damage[best].x1 : x1;
+		y1 = damage[best].y1<y1 ? damage[best].y1 : y1;
+		x2 = damage[best].x2>x2 ? damage[best].x2 : x2;
+		y2 = damage[best].y2>y2 ? damage[best].y2 : y2;
+		damage[best] = damage[--damage_count];
+		// the grown box may now touch others
+		_addDamage(x1, y1, x2, y2);
+		return;
+	}
+
+	damage[damage_count].x1 = x1;
+	damage[damage_count].y1 = y1;
+	damage[damage_count].x2 = x2;
+	damage[damage_count].y2 = y2;
+	damage_count++;
+}
+
+//*********************************
+// CAPTURE
+//*********************************
+// present() copies the areas damaged since the last frame into a 
+// mirror of the screen, from the back buffer when there is one, and a
+// thread encodes and writes it. A frame presented while the thread is
+// still busy is dropped, the next one is then copied in full.
+
+struct _capture {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	int fd;
+	bool own_fd;
+	unsigned char mode;
+	bool stop;
+	bool pending;
+	bool busy;
+	bool stale;
+	bool failed;
+	const _raster_ops *ops;
+	int width, height, stride;
+	unsigned char bypp;
+	// shot is written by present() only while the thread is idle
+	char *shot;
+	char *prev;
+	char *tile;
+	unsigned char *out;
+	unsigned long frame;
+	long long ns;
+	unsigned long frames;
+	unsigned long dropped;
+};
+
+// Packs n pixels of bypp bytes in runs: a byte c < 128 is followed by
+// c+1 pixels, c >= 128 by one pixel that repeats c-126 times.
+static long _packRuns(const char *src, int n, int bypp, unsigned char *out) {
+	long k = 0;
+	int i = 0;
+	while (i<n) {
+		int r = 1;
+		while (i + r<n && r<129 && !memcmp(src + (i + r) * bypp, src + i * bypp, bypp))
+			r++;
+		if (r>1) {
+			out[k++] = r + 126;
+			memcpy(out + k, src + i * bypp, bypp);
+			k += bypp;
+			i += r;
+			continue;
+		}
+		// literals up to the next pair of equal pixels
+		int l = 1;
+		while (i + l<n && l<128 && !(i + l + 1<n && 
+				!memcmp(src + (i + l) * bypp, src + (i + l + 1) * bypp, bypp)))
+			l++;
+		out[k++] = l - 1;
+		memcpy(out + k, src + i * bypp, l * bypp);
+		k += l * bypp;
+		i += l;
+	}
+	return k;
+}
+
+// Most bytes _packRuns() writes for n pixels. Every count byte comes
+// with a pixel at least, a single one between runs of two costs most.
+static long _packBound(int n, int bypp) {
+	return (long)n * (bypp + 1);
+}
+
+static bool _writeAll(int fd, const void *buf, long n) {
+	const char *p = (const char*)buf;
+	while (n>0) {
+		ssize_t k = write(fd, p, n);
+		if (k<0 && errno==EINTR)
+			continue;
+		if (k<=0)
+			return false;
+		p += k;
+		n -= k;
+	}
+	return true;
+}
+
+// Frames as whole RGB24 pictures for CAPTURE_RAW, else the tiles that
+// changed since the last frame written.
+static bool _encodeFrame(_capture *c) {
+	if (c->mode==CAPTURE_RAW) {
+		for (int y=0; y<c->height; y++)
+			c->ops->unpack(c->shot + y * c->stride, c->width, c->out + y * c->width * 3);
+		return _writeAll(c->fd, c->out, (long)c->width * c->height * 3);
+	}
+
+	_capture_frame *f = (_capture_frame*)c->out;
+	long k = sizeof(_capture_frame);
+	f->magic = CAPTURE_FRAME_MAGIC;
+	f->frame = c->frame;
+	f->us = c->ns / 1000;
+	f->tiles = 0;
+	for (int ty=0; ty<c->height; ty+=TILE_H)
+		for (int tx=0; tx<c->width; tx+=TILE_W) {
+			int w = c->width - tx<TILE_W ? c->width - tx : TILE_W;
+			int h = c->height - ty<TILE_H ? c->height - ty : TILE_H;
+			long ofs = (long)ty * c->stride + tx * c->bypp;
+			bool changed = c->frames==0;
+			for (int y=0; y<h && !changed; y++)
+				changed = memcmp(c->shot + ofs + y * c->stride, c->prev + ofs + y * c->stride, 
+					w * c->bypp)!=0;
+			if (!changed)
+				continue;
+			for (int y=0; y<h; y++) {
+				memcpy(c->tile + y * w * c->bypp, c->shot + ofs + y * c->stride, w * c->bypp);
+				memcpy(c->prev + ofs + y * c->stride, c->shot + ofs + y * c->stride, w * c->bypp);
+			}
+			// tiles follow each other unaligned
+			_capture_tile t;
+			t.x = tx;
+			t.y = ty;
+			t.w = w;
+			t.h = h;
+			t.bytes = _packRuns(c->tile, w * h, c->bypp, c->out + k + sizeof(_capture_tile));
+			memcpy(c->out + k, &t, sizeof(t));
+			k += sizeof(_capture_tile) + t.bytes;
+			f->tiles++;
+		}
+	f->bytes = k - sizeof(_capture_frame);
+	return _writeAll(c->fd, c->out, k);
+}
+
+void* RTFT::_captureMain(void *arg) {
+	_capture *c = (_capture*)arg;
+	sigset_t set;
+
+	// a reader that went away fails the write instead of killing us
+	sigemptyset(&set);
+	sigaddset(&set, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	pthread_mutex_lock(&c->lock);
+	for (;;) {
+		while (!c->stop && !c->pending)
+			pthread_cond_wait(&c->wake, &c->lock);
+		if (!c->pending)
+			break;
+		c->pending = false;
+		c->busy = true;
+		pthread_mutex_unlock(&c->lock);
+		bool ok = c->failed || _encodeFrame(c);
+		pthread_mutex_lock(&c->lock);
+		if (!ok) {
+			fprintf(stderr,"RTFT Error 21: cannot write capture.\n");
+			c->failed = true;
+		}
+		if (!c->failed)
+			c->frames++;
+		c->busy = false;
+	}
+	pthread_mutex_unlock(&c->lock);
+	return NULL;
+}
+
+// Flipped pages are kept in memory too while frames are captured or
+// served, updated by present() with the damage of every frame, so the
+// copies of whole frames do not read uncached video memory.
+void RTFT::_shadowPages() {
+	bool flipped = (capture || server) && pages>1 && !backbuf;
+
+	if (flipped && !page_shadow) {
+		page_shadow = (char*)malloc(pages * pagesize);
+		if (page_shadow)
+			memcpy(page_shadow, fbp, pages * pagesize);
+	}
+	if (!flipped) {
+		free(page_shadow);
+		page_shadow = NULL;
+	}
+}
+
+// Brings dst, a copy of the screen as of the last present(), up to
+// date with the frame about to be shown in wbp.
+void RTFT::_copyFrame(char *dst, int stride, bool whole) {
+	const char *src = page_shadow ? page_shadow + write_page * pagesize : wbp;
+
+	// flipped pages do not hold the previous frame, copy them whole
+	if (whole || (pages>1 && !backbuf)) {
+		for (int y=0; y<surface.height; y++)
+			memcpy(dst + y * stride, src + y * surface.stride, surface.width * bypp);
+		return;
+	}
+	for (int i=0; i<damage_count; i++) {
+		long ofs = damage[i].y1 * surface.stride + damage[i].x1 * bypp;
+		long dofs = damage[i].y1 * stride + damage[i].x1 * bypp;
+		int len = (damage[i].x2 - damage[i].x1 + 1) * bypp;
+		for (int y=damage[i].y1; y<=damage[i].y2; y++) {
+			memcpy(dst + dofs, src + ofs, len);
+			ofs += surface.stride;
+			dofs += stride;
+		}
+	}
+}
+
+// Called by present() with the frame about to be shown in wbp.
+void RTFT::_captureFrame() {
+	_capture *c = capture;
+
+	pthread_mutex_lock(&c->lock);
+	if (c->pending || c->busy) {
+		c->dropped++;
+		c->stale = true;
+		pthread_mutex_unlock(&c->lock);
+		return;
+	}
+	_copyFrame(c->shot, c->stride, c->stale);
+	c->stale = false;
+	c->frame = frame_count;
+	c->ns = _clock();
+	c->pending = true;
+	pthread_cond_signal(&c->wake);
+	pthread_mutex_unlock(&c->lock);
+}
+
+// Records every presented frame into a file or pipe, as a stream of
+// changed tiles laid out as described in RTFT.h for CAPTURE_DELTA or
+// as raw RGB24 frames for CAPTURE_RAW, which tools like ffmpeg read 
+// with -f rawvideo -pix_fmt rgb24.
+bool RTFT::startCapture(const char *path, unsigned char mode) {
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd<0) {
+		fprintf(stderr,"RTFT Error 19: cannot open capture file.\n");
+		return false;
+	}
+	if (!startCapture(fd, mode)) {
+		close(fd);
+		return false;
+	}
+	capture->own_fd = true;
+	return true;
+}
+
+// fd is left open by stopCapture().
+bool RTFT::startCapture(int fd, unsigned char mode) {
+	stopCapture();
+	_capture *c = new _capture();
+	int w = surface.width, h = surface.height;
+	int tiles = ((w + TILE_W - 1) / TILE_W) * ((h + TILE_H - 1) / TILE_H);
+	long out = mode==CAPTURE_RAW ? (long)w * h * 3 : sizeof(_capture_frame) + 
+		(long)tiles * (sizeof(_capture_tile) + _packBound(TILE_W * TILE_H, bypp));
+
+	c->fd = fd;
+	c->own_fd = false;
+	c->mode = mode;
+	c->ops = ops;
+	c->width = w;
+	c->height = h;
+	c->bypp = bypp;
+	c->stride = w * bypp;
+	c->stale = true;
+	c->shot = (char*)malloc((long)w * h * bypp);
+	c->out = (unsigned char*)malloc(out);
+	if (mode==CAPTURE_DELTA) {
+		c->prev = (char*)malloc((long)w * h * bypp);
+		c->tile = (char*)malloc(TILE_W * TILE_H * bypp);
+	}
+	pthread_mutex_init(&c->lock, NULL);
+	pthread_cond_init(&c->wake, NULL);
+	capture = c;
+
+	bool ok = c->shot && c->out && (mode==CAPTURE_RAW || (c->prev && c->tile));
+	if (!ok)
+		fprintf(stderr,"RTFT Error 22: cannot allocate capture buffers.\n");
+	if (ok && mode==CAPTURE_DELTA) {
+		_capture_header hd;
+		hd.magic = CAPTURE_MAGIC;
+		hd.width = w;
+		hd.height = h;
+		hd.format = surface.format;
+		hd.bytes = bypp;
+		hd.tile_w = TILE_W;
+		hd.tile_h = TILE_H;
+		if (!_writeAll(fd, &hd, sizeof(hd))) {
+			fprintf(stderr,"RTFT Error 21: cannot write capture.\n");
+			ok = false;
+		}
+	}
+	if (ok && pthread_create(&c->thread, NULL, _captureMain, c)) {
+		fprintf(stderr,"RTFT Error 20: cannot start capture thread.\n");
+		ok = false;
+	}
+	if (!ok) {
+		// no thread to join
+		c->stop = true;
+		stopCapture();
+	}
+	_shadowPages();
+	return ok;
+}
+
+// Writes the frames still queued and ends the capture.
+void RTFT::stopCapture() {
+	_capture *c = capture;
+	if (!c)
+		return;
+
+	pthread_mutex_lock(&c->lock);
+	bool running = !c->stop;
+	c->stop = true;
+	pthread_cond_signal(&c->wake);
+	pthread_mutex_unlock(&c->lock);
+	if (running)
+		pthread_join(c->thread, NULL);
+	if (c->own_fd)
+		close(c->fd);
+	pthread_mutex_destroy(&c->lock);
+	pthread_cond_destroy(&c->wake);
+	free(c->shot);
+	free(c->prev);
+	free(c->tile);
+	free(c->out);
+	delete c;
+	capture = NULL;
+	_shadowPages();
+}
+
+unsigned long RTFT::getCaptureFrames() {
+	if (!capture)
+		return 0;
+	pthread_mutex_lock(&capture->lock);
+	unsigned long n = capture->frames;
+	pthread_mutex_unlock(&capture->lock);
+	return n;
+}
+
+unsigned long RTFT::getCaptureDropped() {
+	return capture ? capture->dropped : 0;
+}
+
+static unsigned int crc_table[256];
+
+static bool _build_crc() {
+	for (unsigned int n=0; n<256; n++) {
+		unsigned int c = n;
+		for (int k=0; k<8; k++)
+			c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+		crc_table[n] = c;
+	}
+	return true;
+}
+
+static bool crc_built = _build_crc();
+
+static unsigned int _crc32(unsigned int crc, const unsigned char *p, long n) {
+	crc = ~crc;
+	while (n--)
+		crc = crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+static void _put32(unsigned char *p, unsigned int v) {
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static bool _pngChunk(FILE *f, const char *type, const unsigned char *data, long n) {
+	unsigned char b[4];
+	_put32(b, n);
+	unsigned int crc = _crc32(_crc32(0, (const unsigned char*)type, 4), data, n);
+	bool ok = fwrite(b, 4, 1, f)==1 && fwrite(type, 4, 1, f)==1 && 
+		(n==0 || fwrite(data, n, 1, f)==1);
+	_put32(b, crc);
+	return ok && fwrite(b, 4, 1, f)==1;
+}
+
+// Saves the picture on display as a binary PPM, or as a PNG when the
+// name ends in .png. PNG data is stored without compression, so no 
+// zlib is needed.
+bool RTFT::saveScreen(const char *path) {
+	int w = surface.width, h = surface.height, len = strlen(path);
+	bool png = len>=4 && !strcasecmp(path + len - 4, ".png");
+	const char *pixels = getPixels();
+	unsigned char *row = (unsigned char*)malloc(w * 3 + 1);
+	FILE *f = fopen(path, "wb");
+	bool ok = f && row;
+
+	if (!png && ok) {
+		ok = fprintf(f, "P6\n%d %d\n255\n", w, h)>0;
+		for (int y=0; y<h && ok; y++) {
+			ops->unpack(pixels + y * surface.stride, w, row);
+			ok = fwrite(row, w * 3, 1, f)==1;
+		}
+	} else if (ok) {
+		// rows of a filter byte and the pixels, in stored deflate blocks
+		long raw = (long)(w * 3 + 1) * h, blocks = (raw + 65534) / 65535;
+		long size = 2 + raw + blocks * 5 + 4;
+		unsigned char *z = (unsigned char*)malloc(size), hd[13];
+		unsigned int s1 = 1, s2 = 0;
+		ok = z!=NULL;
+		if (ok) {
+			long k = 2, left = raw, pos = 0;
+			z[0] = 0x78;
+			z[1] = 0x01;
+			for (int y=0; y<h; y++) {
+				row[0] = 0;
+				ops->unpack(pixels + y * surface.stride, w, row + 1);
+				for (int i=0; i<=w * 3; i++) {
+					if (pos % 65535==0) {
+						int n = left<65535 ? left : 65535;
+						z[k++] = left<=65535;
+						z[k++] = n;
+						z[k++] = n >> 8;
+						z[k++] = ~n;
+						z[k++] = ~n >> 8;
+						left -= n;
+					}
+					z[k++] = row[i];
+					s1 = (s1 + row[i]) % 65521;
+					s2 = (s2 + s1) % 65521;
+					pos++;
+				}
+			}
+			_put32(z + k, s2 << 16 | s1);
+			_put32(hd, w);
+			_put32(hd + 4, h);
+			hd[8] = 8;
+			hd[9] = 2;
+			hd[10] = hd[11] = hd[12] = 0;
+			ok = fwrite("\x89PNG\r\n\x1a\n", 8, 1, f)==1 && _pngChunk(f, "IHDR", hd, 13) && 
+				_pngChunk(f, "IDAT", z, size) && _pngChunk(f, "IEND", NULL, 0);
+		}
+		free(z);
+	}
+	if (!f)
+		fprintf(stderr,"RTFT Error 19: cannot open capture file.\n");
+	else if (fclose(f) || !ok) {
+		fprintf(stderr,"RTFT Error 21: cannot write capture.\n");
+		ok = false;
+	}
+	free(row);
+	return ok;
+}
+
+//*********************************
+// REMOTE VIEW
+//*********************************
+// present() keeps a mirror of the screen like the capture does, and a
+// thread sends every client the tiles that differ from what it was 
+// sent last, at most fps times a second. A client is sent no new frame
+// while the last one has not left its socket, so a slow client only
+// sees fewer frames and present() never waits for one.
+
+struct _client {
+	int fd;
+	bool full;
+	unsigned long seen;
+	long long next;
+	// the screen as last sent
+	char *prev;
+	unsigned char *out;
+	long len;
+	long sent;
+};
+
+struct _server {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	int listen_fd;
+	int wake[2];
+	char path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+	bool stop;
+	const _raster_ops *ops;
+	int width, height, stride;
+	unsigned char bypp;
+	unsigned char format;
+	long long interval;
+	long out_size;
+	// shot, dirty and the frame fields are shared with present()
+	char *shot;
+	bool stale;
+	_rect dirty[MAX_DAMAGE];
+	unsigned char dirty_count;
+	bool dirty_all;
+	unsigned long serial;
+	unsigned long frame;
+	long long ns;
+	// view is the frame being sent
+	char *view;
+	unsigned long view_frame;
+	long long view_ns;
+	unsigned char *rgb;
+	unsigned char *index;
+	_client clients[REMOTE_CLIENTS];
+	unsigned char count;
+};
+
+// Packs the w x h RGB24 pixels in s->rgb into out, as indices into a
+// palette when there are at most 16 colors, else as runs of pixels.
+static long _encodeTile(_server *s, int w, int h, _remote_tile *t, unsigned char *out) {
+	const unsigned char *p = s->rgb;
+	unsigned char *idx = s->index;
+	unsigned int pal[16];
+	int n = w * h, colors = 0;
+
+	for (int i=0; i<n; i++, p+=3) {
+		unsigned int c = p[0] | p[1] << 8 | p[2] << 16;
+		int k = 0;
+		while (k<colors && pal[k]!=c)
+			k++;
+		if (k==colors) {
+			if (colors==16) {
+				t->encoding = REMOTE_RUNS;
+				t->colors = 0;
+				return _packRuns((const char*)s->rgb, n, 3, out);
+			}
+			pal[colors++] = c;
+		}
+		idx[i] = k;
+	}
+	// rows are packed in place, never longer than the indices they hold
+	int bits = colors<=2 ? 1 : colors<=4 ? 2 : 4;
+	int per = 8 / bits;
+	int row = (w + per - 1) / per;
+	for (int y=0; y<h; y++) {
+		const unsigned char *src = idx + y * w;
+		for (int x=0; x<w; x+=per) {
+			unsigned char b = 0;
+			for (int j=0; j<per; j++)
+				b = b << bits | (x + j<w ? src[x + j] : 0);
+			idx[y * row + x / per] = b;
+		}
+	}
+	for (int k=0; k<colors; k++) {
+		out[k * 3] = pal[k];
+		out[k * 3 + 1] = pal[k] >> 8;
+		out[k * 3 + 2] = pal[k] >> 16;
+	}
+	t->encoding = REMOTE_PALETTE;
+	t->colors = colors;
+	return colors * 3 + _packRuns((const char*)idx, row * h, 1, out + colors * 3);
+}
+
+// The tiles of s->view that changed since cl was sent a frame, nothing
+// when there are none.
+static long _encodeView(_server *s, _client *cl, unsigned char *out) {
+	long k = sizeof(_capture_frame);
+	unsigned int tiles = 0;
+
+	for (int ty=0; ty<s->height; ty+=TILE_H)
+		for (int tx=0; tx<s->width; tx+=TILE_W) {
+			int w = s->width - tx<TILE_W ? s->width - tx : TILE_W;
+			int h = s->height - ty<TILE_H ? s->height - ty : TILE_H;
+			long ofs = (long)ty * s->stride + tx * s->bypp;
+			bool changed = cl->full;
+			for (int y=0; y<h && !changed; y++)
+				changed = memcmp(s->view + ofs + y * s->stride, cl->prev + ofs + y * s->stride, 
+					w * s->bypp)!=0;
+			if (!changed)
+				continue;
+			for (int y=0; y<h; y++) {
+				memcpy(cl->prev + ofs + y * s->stride, s->view + ofs + y * s->stride, w * s->bypp);
+				s->ops->unpack(s->view + ofs + y * s->stride, w, s->rgb + y * w * 3);
+			}
+			_remote_tile t;
+			t.x = tx;
+			t.y = ty;
+			t.w = w;
+			t.h = h;
+			t.pad = 0;
+			t.bytes = _encodeTile(s, w, h, &t, out + k + sizeof(_remote_tile));
+			memcpy(out + k, &t, sizeof(t));
+			k += sizeof(_remote_tile) + t.bytes;
+			tiles++;
+		}
+	cl->full = false;
+	if (!tiles)
+		return 0;
+
+	_capture_frame f;
+	f.magic = CAPTURE_FRAME_MAGIC;
+	f.frame = s->view_frame;
+	f.us = s->view_ns / 1000;
+	f.tiles = tiles;
+	f.bytes = k - sizeof(_capture_frame);
+	memcpy(out, &f, sizeof(f));
+	return k;
+}
+
+// A full pipe has a wake up in it already.
+static void _wakeServer(_server *s) {
+	ssize_t k = write(s->wake[1], "", 1);
+	(void)k;
+}
+
+static void _acceptClient(_server *s) {
+	int fd = accept4(s->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if (fd<0)
+		return;
+	if (s->count==REMOTE_CLIENTS) {
+		close(fd);
+		return;
+	}
+	_client *cl = &s->clients[s->count];
+	cl->prev = (char*)malloc((long)s->height * s->stride);
+	cl->out = (unsigned char*)malloc(s->out_size);
+	if (!cl->prev || !cl->out) {
+		fprintf(stderr,"RTFT Error 25: cannot allocate remote view buffers.\n");
+		free(cl->prev);
+		free(cl->out);
+		close(fd);
+		return;
+	}
+	_capture_header hd;
+	hd.magic = REMOTE_MAGIC;
+	hd.width = s->width;
+	hd.height = s->height;
+	hd.format = s->format;
+	hd.bytes = 3;
+	hd.tile_w = TILE_W;
+	hd.tile_h = TILE_H;
+	memcpy(cl->out, &hd, sizeof(hd));
+	cl->len = sizeof(hd);
+	cl->sent = 0;
+	cl->fd = fd;
+	cl->full = true;
+	cl->seen = 0;
+	cl->next = 0;
+	pthread_mutex_lock(&s->lock);
+	s->count++;
+	pthread_mutex_unlock(&s->lock);
+}
+
+static void _dropClient(_server *s, int i) {
+	close(s->clients[i].fd);
+	free(s->clients[i].prev);
+	free(s->clients[i].out);
+	pthread_mutex_lock(&s->lock);
+	s->clients[i] = s->clients[--s->count];
+	pthread_mutex_unlock(&s->lock);
+}
+
+void* RTFT::_serverMain(void *arg) {
+	_server *s = (_server*)arg;
+	struct pollfd fds[2 + REMOTE_CLIENTS];
+	char buf[256];
+
+	for (;;) {
+		pthread_mutex_lock(&s->lock);
+		bool stop = s->stop;
+		unsigned long serial = s->serial;
+		pthread_mutex_unlock(&s->lock);
+		if (stop)
+			break;
+
+		long long now = _clock();
+		int timeout = -1;
+		bool due = false;
+		for (int i=0; i<s->count; i++) {
+			_client *cl = &s->clients[i];
+			if (cl->len || !serial || cl->seen==serial)
+				continue;
+			if (now<cl->next) {
+				int ms = (cl->next - now + 999999) / 1000000;
+				if (timeout<0 || ms<timeout)
+					timeout = ms;
+			} else
+				due = true;
+		}
+		if (due) {
+			// take the frame, copying only what changed since the last
+			pthread_mutex_lock(&s->lock);
+			if (s->dirty_all) {
+				memcpy(s->view, s->shot, (long)s->height * s->stride);
+			} else {
+				for (int i=0; i<s->dirty_count; i++) {
+					const _rect *r = &s->dirty[i];
+					long ofs = r->y1 * s->stride + r->x1 * s->bypp;
+					for (int y=r->y1; y<=r->y2; y++, ofs+=s->stride)
+						memcpy(s->view + ofs, s->shot + ofs, (r->x2 - r->x1 + 1) * s->bypp);
+				}
+			}
+			s->dirty_all = false;
+			s->dirty_count = 0;
+			serial = s->serial;
+			s->view_frame = s->frame;
+			s->view_ns = s->ns;
+			pthread_mutex_unlock(&s->lock);
+			for (int i=0; i<s->count; i++) {
+				_client *cl = &s->clients[i];
+				if (cl->len || cl->seen==serial || now<cl->next)
+					continue;
+				cl->len = _encodeView(s, cl, cl->out);
+				cl->seen = serial;
+				if (cl->len)
+					cl->next = now + s->interval;
+			}
+		}
+
+		fds[0].fd = s->wake[0];
+		fds[0].events = POLLIN;
+		fds[1].fd = s->listen_fd;
+		fds[1].events = POLLIN;
+		for (int i=0; i<s->count; i++) {
+			fds[2 + i].fd = s->clients[i].fd;
+			fds[2 + i].events = POLLIN | (s->clients[i].len ? POLLOUT : 0);
+		}
+		int n = s->count;
+		if (poll(fds, 2 + n, timeout)<0)
+			continue;
+		if (fds[0].revents)
+			while (read(s->wake[0], buf, sizeof(buf))>0)
+				;
+		// backwards, as a dropped client is replaced by the last one
+		for (int i=n - 1; i>=0; i--) {
+			_client *cl = &s->clients[i];
+			short ev = fds[2 + i].revents;
+			bool drop = ev & (POLLERR | POLLNVAL);
+			if (!drop && ev & (POLLIN | POLLHUP)) {
+				// clients have nothing to say, but closing
+				ssize_t k = recv(cl->fd, buf, sizeof(buf), MSG_DONTWAIT);
+				drop = k==0 || (k<0 && errno!=EAGAIN && errno!=EINTR);
+			}
+			if (!drop && ev & POLLOUT) {
+				ssize_t k = send(cl->fd, cl->out + cl->sent, cl->len - cl->sent, 
+					MSG_DONTWAIT | MSG_NOSIGNAL);
+				if (k>0) {
+					cl->sent += k;
+					if (cl->sent==cl->len)
+						cl->len = cl->sent = 0;
+				} else 
+					drop = k<0 && errno!=EAGAIN && errno!=EINTR;
+			}
+			if (drop)
+				_dropClient(s, i);
+		}
+		if (fds[1].revents & POLLIN)
+			_acceptClient(s);
+	}
+	return NULL;
+}
+
+// Called by present() with the frame about to be shown in wbp.
+void RTFT::_serveFrame() {
+	_server *s = server;
+	bool whole = s->stale || (pages>1 && !backbuf);
+	if (!whole && !damage_count)
+		return;
+
+	pthread_mutex_lock(&s->lock);
+	_copyFrame(s->shot, s->stride, s->stale);
+	if (whole || s->dirty_count + damage_count>MAX_DAMAGE) {
+		s->dirty_all = true;
+	} else {
+		memcpy(s->dirty + s->dirty_count, damage, damage_count * sizeof(_rect));
+		s->dirty_count += damage_count;
+	}
+	s->stale = false;
+	s->serial++;
+	s->frame = frame_count;
+	s->ns = _clock();
+	pthread_mutex_unlock(&s->lock);
+	_wakeServer(s);
+}
+
+bool RTFT::_serve(int fd, const char *path, unsigned char fps) {
+	_server *s = new _server();
+	int w = surface.width, h = surface.height;
+	int tiles = ((w + TILE_W - 1) / TILE_W) * ((h + TILE_H - 1) / TILE_H);
+
+	s->listen_fd = fd;
+	s->wake[0] = s->wake[1] = -1;
+	if (path)
+		strcpy(s->path, path);
+	s->ops = ops;
+	s->width = w;
+	s->height = h;
+	s->bypp = bypp;
+	s->stride = w * bypp;
+	s->format = surface.format;
+	s->interval = 1000000000LL / (fps ? fps : 1);
+	s->out_size = sizeof(_capture_header) + sizeof(_capture_frame) + 
+		(long)tiles * (sizeof(_remote_tile) + _packBound(TILE_W * TILE_H, 3));
+	s->stale = true;
+	s->dirty_all = true;
+	s->shot = (char*)malloc((long)w * h * bypp);
+	s->view = (char*)malloc((long)w * h * bypp);
+	s->rgb = (unsigned char*)malloc(TILE_W * TILE_H * 3);
+	s->index = (unsigned char*)malloc(TILE_W * TILE_H);
+	pthread_mutex_init(&s->lock, NULL);
+	server = s;
+
+	bool ok = s->shot && s->view && s->rgb && s->index;
+	if (!ok)
+		fprintf(stderr,"RTFT Error 25: cannot allocate remote view buffers.\n");
+	if (ok && pipe2(s->wake, O_NONBLOCK | O_CLOEXEC)) {
+		fprintf(stderr,"RTFT Error 23: cannot open remote view socket.\n");
+		ok = false;
+	}
+	if (ok && pthread_create(&s->thread, NULL, _serverMain, s)) {
+		fprintf(stderr,"RTFT Error 24: cannot start remote view thread.\n");
+		ok = false;
+	}
+	if (!ok) {
+		// no thread to join
+		s->stop = true;
+		stopServer();
+	}
+	_shadowPages();
+	return ok;
+}
+
+// Serves a live view of the screen on a Unix domain socket at path, to
+// up to REMOTE_CLIENTS clients at once, each sent at most fps frames a 
+// second. The stream is described in RTFT.h, view.cpp is a client.
+bool RTFT::startServer(const char *path, unsigned char fps) {
+	struct sockaddr_un addr;
+	struct stat st;
+
+	stopServer();
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path)>=sizeof(addr.sun_path)) {
+		fprintf(stderr,"RTFT Error 23: cannot open remote view socket.\n");
+		return false;
+	}
+	strcpy(addr.sun_path, path);
+	// a socket left by a program that did not stop its server
+	if (!lstat(path, &st) && S_ISSOCK(st.st_mode))
+		unlink(path);
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd<0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr))) {
+		fprintf(stderr,"RTFT Error 23: cannot open remote view socket.\n");
+		if (fd>=0)
+			close(fd);
+		return false;
+	}
+	if (listen(fd, REMOTE_CLIENTS)) {
+		fprintf(stderr,"RTFT Error 23: cannot open remote view socket.\n");
+		close(fd);
+		unlink(path);
+		return false;
+	}
+	return _serve(fd, path, fps);
+}
+
+// The same on the TCP port of the loopback address only.
+bool RTFT::startServer(unsigned short int port, unsigned char fps) {
+	struct sockaddr_in addr;
+	int one = 1;
+
+	stopServer();
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd<0 || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) || 
+			bind(fd, (struct sockaddr*)&addr, sizeof(addr)) || listen(fd, REMOTE_CLIENTS)) {
+		fprintf(stderr,"RTFT Error 23: cannot open remote view socket.\n");
+		if (fd>=0)
+			close(fd);
+		return false;
+	}
+	return _serve(fd, NULL, fps);
+}
+
+// Disconnects the clients and closes the socket.
+void RTFT::stopServer() {
+	_server *s = server;
+	if (!s)
+		return;
+
+	pthread_mutex_lock(&s->lock);
+	bool running = !s->stop;
+	s->stop = true;
+	pthread_mutex_unlock(&s->lock);
+	if (running) {
+		_wakeServer(s);
+		pthread_join(s->thread, NULL);
+	}
+	while (s->count)
+		_dropClient(s, s->count - 1);
+	close(s->listen_fd);
+	if (s->path[0])
+		unlink(s->path);
+	if (s->wake[0]>=0) {
+		close(s->wake[0]);
+		close(s->wake[1]);
+	}
+	pthread_mutex_destroy(&s->lock);
+	free(s->shot);
+	free(s->view);
+	free(s->rgb);
+	free(s->index);
+	delete s;
+	server = NULL;
+	_shadowPages();
+}
+
+unsigned char RTFT::getServerClients() {
+	if (!server)
+		return 0;
+	pthread_mutex_lock(&server->lock);
+	unsigned char n = server->count;
+	pthread_mutex_unlock(&server->lock);
+	return n;
+}
+
+void RTFT::_convert_float(char *buf, float num, unsigned short int width, 
+unsigned char prec) {
+	
+	char format[10];
+	sprintf(format, "%%%i.%if", width, prec);
+	sprintf(buf, format, num);
+}
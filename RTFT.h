@@ -7,10 +7,20 @@
 #include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <time.h>
 #include <linux/fb.h>
 #include <sys/mman.h>
 #include <sys/ioctl.h>
-#include <DefaultFonts.c>
+#include <pthread.h>
+
+#define fontdatatype const unsigned char
+
+// Compiled once into RTFT.cpp from DefaultFonts.c, and registered as 
+// fonts of the same names.
+extern fontdatatype SmallFont[];
+extern fontdatatype BigFont[];
+extern fontdatatype SevenSegNumFont[];
 
 #define LEFT 0
 #define RIGHT 9999
@@ -19,6 +29,68 @@
 #define PORTRAIT 0
 #define LANDSCAPE 1
 
+#define ROTATE_NEAREST 0
+#define ROTATE_BILINEAR 1
+
+#define FILL_EVENODD 0
+#define FILL_NONZERO 1
+
+#define PIXFMT_INDEXED8 0
+#define PIXFMT_RGB565 1
+#define PIXFMT_RGB888 2
+#define PIXFMT_BGR888 3
+#define PIXFMT_XRGB8888 4
+#define PIXFMT_XBGR8888 5
+
+#define SURFACE_FBDEV 0
+#define SURFACE_MEMORY 1
+#define SURFACE_FILE 2
+
+#define MAX_PAGES 4
+#define MAX_DAMAGE 32
+#define FRAME_HISTORY 128
+#define MAX_CLIP 16
+#define GLYPH_CACHE 64
+#define TEXT_CACHE 16
+#define TEXT_PIXELS (1 << 19)
+#define MAX_THREADS 8
+#define TILE_W 64
+#define TILE_H 32
+
+// Instrumented methods, counted when built with -DRTFT_STATS
+#define STAT_DRAWRECT 0
+#define STAT_DRAWROUNDRECT 1
+#define STAT_FILLRECT 2
+#define STAT_FILLROUNDRECT 3
+#define STAT_DRAWCIRCLE 4
+#define STAT_FILLCIRCLE 5
+#define STAT_FILLSCR 6
+#define STAT_DRAWPIXEL 7
+#define STAT_DRAWLINE 8
+#define STAT_DRAWHLINE 9
+#define STAT_DRAWVLINE 10
+#define STAT_PRINTCHAR 11
+#define STAT_ROTATECHAR 12
+#define STAT_PRINT 13
+#define STAT_PRINTNUMI 14
+#define STAT_PRINTNUMF 15
+#define STAT_DRAWBITMAP 16
+#define STAT_ROTATEBITMAP 17
+#define STAT_COPYBITMAP 18
+#define STAT_PRESENT 19
+#define STAT_FILLMASK 20
+#define STAT_DRAWBITMAPMASK 21
+#define STAT_DRAWLINEAA 22
+#define STAT_DRAWARCAA 23
+#define STAT_FILLTRIANGLE 24
+#define STAT_FILLPOLYGON 25
+#define STAT_FILLPIE 26
+#define STAT_FILLARC 27
+#define STAT_DRAWELLIPSE 28
+#define STAT_FILLELLIPSE 29
+#define STAT_PRINTBOX 30
+#define STAT_COUNT 31
+
 //*********************************
 // COLORS
 //*********************************
@@ -46,6 +118,64 @@
 #define fontbyte(x) cfont.font[x] 
 #define bitmapdatatype unsigned short*
 
+// A font compiled into runs of set pixels by RTFT_SPAN_FONT. Row r of
+// glyph g has the (start, length) pairs from runs[rows[i]] up to 
+// runs[rows[i + 1]], where i = g * y_size + r.
+struct _span_font
+{
+	const unsigned char *font;
+	const unsigned short *rows;
+	const unsigned char *runs;
+};
+
+// Runs of set bits in the rows of all glyphs of a constexpr font.
+constexpr int _fontRuns(const unsigned char *font) {
+	int n = 0, bpr = font[0] / 8;
+	for (int i=0; i<font[1] * font[3]; i++) {
+		const unsigned char *b = font + 4 + i * bpr;
+		for (int x=0; x<font[0]; x++)
+			if ((b[x>>3] & (0x80>>(x&7))) && (x==0 || !(b[(x-1)>>3] & (0x80>>((x-1)&7)))))
+				n++;
+	}
+	return n;
+}
+
+template<int ROWS, int RUNS>
+struct _span_table
+{
+	static_assert(2 * RUNS<65536, "too many runs in the font");
+	unsigned short rows[ROWS + 1];
+	unsigned char runs[2 * RUNS + 1];
+
+	constexpr _span_table(const unsigned char *font) : rows(), runs() {
+		int n = 0, bpr = font[0] / 8;
+		for (int i=0; i<ROWS; i++) {
+			const unsigned char *b = font + 4 + i * bpr;
+			rows[i] = n;
+			for (int x=0; x<font[0]; x++) {
+				if (!(b[x>>3] & (0x80>>(x&7))))
+					continue;
+				int start = x;
+				while (x + 1<font[0] && (b[(x+1)>>3] & (0x80>>((x+1)&7))))
+					x++;
+				runs[n++] = start;
+				runs[n++] = x - start + 1;
+			}
+		}
+		rows[ROWS] = n;
+	}
+};
+
+// Defines name, a _span_font built by the compiler from a font array
+// defined constexpr, to be given to RTFT::registerFont(). A UTFT font
+// file included with fontdatatype redefined as constexpr unsigned char
+// defines such an array.
+#define RTFT_SPAN_FONT(name, font) \
+	static constexpr _span_table<(font)[1] * (font)[3], _fontRuns(font)> name##_table(font); \
+	static constexpr _span_font name = { font, name##_table.rows, name##_table.runs }
+
+struct _font;
+
 struct _current_font
 {
 	const unsigned char* font;
@@ -53,32 +183,499 @@ struct _current_font
 	unsigned char y_size;
 	unsigned char offset;
 	unsigned char numchars;
+	const _span_font *spans;
+	const _font *prop;
+};
+
+struct _rect
+{
+	short int x1;
+	short int y1;
+	short int x2;
+	short int y2;
+};
+
+struct _point
+{
+	short int x;
+	short int y;
+};
+
+struct _clip
+{
+	int x1;
+	int y1;
+	int x2;
+	int y2;
+	int ox;
+	int oy;
+	int w;
+	int h;
+};
+
+// The pixels drawn on: a framebuffer device, heap memory or a mapped
+// file.
+struct _surface
+{
+	int width;
+	int height;
+	int stride;
+	unsigned char format;
+	unsigned char type;
+};
+
+struct _frame_stats
+{
+	unsigned long render_us;
+	unsigned long present_us;
+	unsigned long interval_us;
+	bool missed;
+};
+
+#define MAX_FONTS 32
+#define FONT_NAME 32
+
+// Proportional fonts have glyphs of their own width, code points up to
+// 0x10FFFF and kerning pairs. Their bytes, numbers little endian:
+//   0   FONT_MAGIC, its 0 tells them from UTFT fonts, never 0 wide
+//   4   u32 bytes of the whole font
+//   8   u8 height, rows of every glyph, u8 ascent, rows above the baseline
+//   10  u16 glyphs, u16 ranges, u16 kerning pairs
+//   16  per glyph 8 bytes: u32 offset of its rows, u8 width, s8 columns
+//       from the pen to the first one, u8 advance of the pen, u8 0
+//       per range 8 bytes: u32 first code point, u16 count, u16 glyph
+//       of the first, ascending and apart
+//       per pair 6 bytes: u16 left glyph, u16 right glyph, s16 change
+//       of the advance, ascending by left glyph
+// then the glyph rows, (width + 7) / 8 bytes each, top bit leftmost.
+// fontconv.cpp makes them from BDF fonts.
+#define FONT_MAGIC "\0RFN"
+#define FONT_HEADER 16
+#define FONT_DIRECT 0x250
+
+struct _font_glyph
+{
+	const unsigned char *bits;
+	unsigned char width;
+	signed char left;
+	unsigned char advance;
+	unsigned short kern;
+	unsigned short kerns;
+};
+
+struct _font_range
+{
+	unsigned int first;
+	unsigned short count;
+	unsigned short glyph;
+};
+
+struct _font_kern
+{
+	unsigned short right;
+	short adjust;
+};
+
+// A font of the registry, see RTFT::loadFont(). data is the font with
+// its header, valid for the numchars glyphs from offset on. A 
+// proportional font has glyphs instead, x_size is its widest advance
+// and direct holds glyph + 1 of the code points below FONT_DIRECT, 0
+// for those it lacks, the rest are found in ranges.
+struct _font
+{
+	char name[FONT_NAME];
+	const unsigned char *data;
+	long int size;
+	unsigned char x_size;
+	unsigned char y_size;
+	unsigned char offset;
+	unsigned char numchars;
+	bool mapped;
+	const _span_font *spans;
+	unsigned char ascent;
+	unsigned short glyph_count;
+	unsigned short range_count;
+	_font_glyph *glyphs;
+	_font_range *ranges;
+	_font_kern *kerns;
+	unsigned short *direct;
+};
+
+// Flags of RTFT::printBox(), one horizontal and one vertical alignment
+#define TEXT_LEFT 0
+#define TEXT_CENTER 1
+#define TEXT_RIGHT 2
+#define TEXT_TOP 0
+#define TEXT_MIDDLE 4
+#define TEXT_BOTTOM 8
+#define TEXT_WRAP 16
+#define TEXT_ELLIPSIS 32
+
+// A line of a laid out text, length bytes from start, width pixels wide
+// with the ellipsis when it ends in one.
+struct _text_line
+{
+	int start;
+	int length;
+	int width;
+	bool ellipsis;
+};
+
+// A text laid out in a box of width by height pixels, 0 for no limit,
+// in font with flags. A box drawn opaque and whole keeps its pixels,
+// drawn in color on back, to be copied the next time.
+struct _text_layout
+{
+	unsigned int hash;
+	char *text;
+	const unsigned char *font;
+	unsigned short width;
+	unsigned short height;
+	unsigned char flags;
+	unsigned long used;
+	int count;
+	_text_line *lines;
+	char *pixels;
+	unsigned short color;
+	unsigned short back;
+};
+
+struct _text_size
+{
+	int width;
+	int height;
+	int lines;
+};
+
+#define NUMFIELD_LEN 26
+
+// A number printed over and over at the same place, set up by 
+// RTFT::initField(). text holds the count characters shown, drawn with
+// font in cells of w by h, color and back.
+struct _numfield
+{
+	unsigned short x;
+	unsigned short y;
+	unsigned char length;
+	char filler;
+	char divider;
+	unsigned char count;
+	const unsigned char *font;
+	unsigned char w;
+	unsigned char h;
+	unsigned short color;
+	unsigned short back;
+	char text[NUMFIELD_LEN + 1];
+};
+
+// A glyph expanded for the current pixel format. Opaque glyphs keep 
+// ready to copy pixel rows, transparent ones the runs of set bits of
+// each row and are drawn with the current color.
+struct _glyph
+{
+	const unsigned char* font;
+	unsigned short index;
+	bool transparent;
+	unsigned int fg;
+	unsigned int bg;
+	unsigned long used;
+	bool expanded;
+	char *pixels;
+	unsigned short *runs;
+	long int size;
+};
+
+struct _prim_stats
+{
+	char name[16];
+	unsigned long long calls;
+	unsigned long long pixels;
+	unsigned long long bytes;
+	unsigned long long ns;
+};
+
+// Layout of the file written by setStatsDump(). seq is odd while the
+// counters are being written, a reader copies them and retries if seq
+// changed meanwhile.
+struct _stats_file
+{
+	unsigned int magic;
+	unsigned int seq;
+	unsigned int count;
+	unsigned int pad;
+	unsigned long long frame;
+	_prim_stats stats[STAT_COUNT];
+};
+
+#define STATS_MAGIC 0x53465452
+
+#define CAPTURE_DELTA 0
+#define CAPTURE_RAW 1
+
+// Layout of a CAPTURE_DELTA stream: a _capture_header, then for every
+// presented frame a _capture_frame followed by the tiles that changed
+// since the frame before, each a _capture_tile and bytes of its pixels
+// in the surface format, row after row, packed in runs: a byte c < 128
+// is followed by c+1 pixels, c >= 128 by one pixel repeated c-126 
+// times. The first frame holds every tile.
+struct _capture_header
+{
+	unsigned int magic;
+	unsigned short width;
+	unsigned short height;
+	unsigned char format;
+	unsigned char bytes;
+	unsigned char tile_w;
+	unsigned char tile_h;
+};
+
+struct _capture_frame
+{
+	unsigned int magic;
+	unsigned int frame;
+	unsigned long long us;
+	unsigned int tiles;
+	unsigned int bytes;
+};
+
+struct _capture_tile
+{
+	unsigned short x;
+	unsigned short y;
+	unsigned short w;
+	unsigned short h;
+	unsigned int bytes;
+};
+
+#define CAPTURE_MAGIC 0x43465452
+#define CAPTURE_FRAME_MAGIC 0x46465452
+
+#define REMOTE_CLIENTS 4
+#define REMOTE_FPS 10
+#define REMOTE_RUNS 0
+#define REMOTE_PALETTE 1
+
+// A remote view client reads a _capture_header with REMOTE_MAGIC and 
+// bytes 3, then _capture_frame records as in a CAPTURE_DELTA stream
+// whose tiles are _remote_tile records, with pixels as RGB24. The
+// bytes of a REMOTE_RUNS tile are its pixels packed in runs like the
+// capture tiles. A REMOTE_PALETTE tile starts with its colors, then 
+// has the index of every pixel in 1, 2 or 4 bits for up to 2, 4 or 16
+// colors, high bits first and every row starting on a byte, packed in
+// runs of bytes. The first frame a client gets holds every tile.
+struct _remote_tile
+{
+	unsigned short x;
+	unsigned short y;
+	unsigned short w;
+	unsigned short h;
+	unsigned char encoding;
+	unsigned char colors;
+	unsigned short pad;
+	unsigned int bytes;
+};
+
+#define REMOTE_MAGIC 0x56525452
+
+// A drawing call recorded in a display list, with the colors, font and
+// bitmap state it was made with. The colors are kept converted too, for
+// pixels of format, as exact as they were set. a[] holds the arguments,
+// bx1..by2 the box it can touch in the coordinates of the viewport.
+struct _command
+{
+	unsigned char op;
+	unsigned char flags;
+	unsigned short color;
+	unsigned short back;
+	unsigned short param;
+	unsigned int key;
+	unsigned char alpha;
+	unsigned char format;
+	unsigned int native;
+	unsigned int native_back;
+	int a[6];
+	int bx1;
+	int by1;
+	int bx2;
+	int by2;
+	const void *data;
+	const unsigned char *mask;
+};
+
+struct _raster_ops;
+struct _probe;
+struct _worker;
+struct _pool;
+struct _capture;
+struct _server;
+
+// Commands recorded between RTFT::beginList() and endList(). Bitmaps,
+// fonts, polygon points and source displays are referenced, not 
+// copied, and must stay valid until the list is drawn.
+class RTFTList
+{
+	_command *cmds;
+	int count;
+	int size;
+	friend class RTFT;
+
+	public:
+
+RTFTList();
+~RTFTList();
+void clear();
+int getCount();
 };
 
 class RTFT
 {
 	long int screensize;
+	long int pagesize;
 	char *fbp;
+	char *wbp;
+	char *backbuf;
+	char *page_shadow;
 	int fbfd;
+	unsigned char pages;
+	unsigned char write_page;
+	unsigned char display_page;
+	unsigned char bypp;
+	const _raster_ops *ops;
+	_surface surface;
 	struct fb_var_screeninfo orig_vinfo;
 	struct fb_var_screeninfo vinfo;
 	struct fb_fix_screeninfo finfo;
 
 	_current_font	cfont;
     bool	_transparent;
+	unsigned char	rotate_filter;
+	unsigned int	bitmap_key;
+	unsigned char	alpha;
+	unsigned short	alpha_w;
     unsigned short int     current_color;
 	unsigned short int     current_back_color;
+	unsigned int	native_color;
+	unsigned int	native_back_color;
+
+	_clip	clip;
+	_clip	clip_stack[MAX_CLIP];
+	unsigned char	clip_depth;
+	unsigned int	clip_overflow;
+
+	_rect	damage[MAX_DAMAGE];
+	unsigned char	damage_count;
+
+	_frame_stats	frame_stats[FRAME_HISTORY];
+	unsigned long	frame_count;
+	unsigned long	missed_frames;
+	long long	frame_ns;
+	long long	frame_deadline;
+	long long	frame_end;
+	bool	vsync;
+	signed char	vsync_state;
+
+	RTFTList	*recording;
+	_pool	*pool;
+	_capture	*capture;
+	_server	*server;
+
+	_glyph	glyphs[GLYPH_CACHE];
+	unsigned char	glyph_count;
+	unsigned long	glyph_tick;
+	unsigned long	glyph_hits;
+	unsigned long	glyph_misses;
+
+	_text_layout	texts[TEXT_CACHE];
+	unsigned char	text_count;
+	unsigned long	text_tick;
+
+#ifdef RTFT_STATS
+	_prim_stats	prim_stats[STAT_COUNT];
+	unsigned long long	stat_pixels;
+	unsigned int	stat_every;
+	int	stat_fd;
+	_stats_file	*stat_file;
+	friend struct _probe;
+#endif
+
+	void _pixel(int x, int y);
+	void _pixel(int x, int y, unsigned int color);
+	void _rawPixel(int x, int y);
+	void _rawPixel(int x, int y, unsigned int color);
+	void _store(char *p, unsigned int color);
+	void _blendRows(char *line, const unsigned short *src, int sstride, 
+		const unsigned char *mask, int mstride, int w, int h);
+	void _loadPalette();
+	void _initState();
+	bool _setSurface(int width, int height, unsigned char format, int stride);
+	unsigned char _initPages(unsigned char npages);
+	void _hline(int x, int y, int l);
+	void _aaPixel(int x, int y, int cov);
+	void _circleAA(int cx, int cy, int r, int start, int end);
+	void _fillPolygon(const _point *points, int n, int ox, int oy, unsigned char rule);
+	void _fillArc(int cx, int cy, int r, int inner, int start, int end);
+	void _fillRound(int x1, int y1, int x2, int y2, int rx, int ry);
+	void _drawRound(int x1, int y1, int x2, int y2, int rx, int ry);
+	void _vline(int x, int y, int l);
+	int _outcode(int x, int y);
+	bool _clipRect(int &x1, int &y1, int &x2, int &y2);
+	void _pushClip(int x1, int y1, int x2, int y2, bool origin);
+	void _addDamage(int x1, int y1, int x2, int y2);
+	void _waitFrame();
+	_command* _record(unsigned char op, int bx1, int by1, int bx2, int by2);
+	void _sortList(RTFTList *list);
+	void _drawCommand(const _command *c);
+	bool _drawTiles(RTFTList *list);
+	void _drawTile(_pool *p, int t);
+	static void _runTiles(_worker *w);
+	static void* _workerMain(void *arg);
+	void _shadowPages();
+	void _copyFrame(char *dst, int stride, bool whole);
+	void _captureFrame();
+	static void* _captureMain(void *arg);
+	bool _serve(int fd, const char *path, unsigned char fps);
+	void _serveFrame();
+	static void* _serverMain(void *arg);
+	void _formatNumF(char *st, float num, unsigned char dec, char divider, int length, char filler);
+	void _printField(_numfield *field, const char *st);
+	int _glyphIndex(unsigned int code);
+	const unsigned char* _glyphBits(int index, int &w, int &bpr);
+	void _drawGlyph(int index, int x, int y);
+	void _rotateGlyph(int index, int x, int y, int pen, unsigned short deg);
+	void _fillBack(int x1, int y1, int x2, int y2);
+	void _printLine(const char *st, int n, int x, int y, unsigned short deg);
+	int _advance(unsigned int code, int &prev);
+	int _lineWidth(const char *st, int n);
+	const char* _ellipsis();
+	int _trimLine(const char *st, int n, int width);
+	int _layoutLines(const char *st, int width, int max, unsigned char flags, _text_line **out);
+	_text_layout* _layoutText(const char *st, int width, int height, unsigned char flags);
+	void _spanGlyph(char *line, int index, int row1, int row2, int col1, int col2);
+	const _glyph* _getGlyph(int index);
+	bool _expandGlyph(_glyph *g, int index);
+	static long long _clock();
 	
 	public:
 
 ~RTFT();     
-unsigned char init(unsigned short int x, unsigned short int y);
+unsigned char init(unsigned short int x, unsigned short int y, unsigned char npages=1, bool shadow=false);
+unsigned char initDevice(const char *device, unsigned short int x, unsigned short int y, unsigned char npages=1, bool shadow=false);
+unsigned char initMemory(unsigned short int x, unsigned short int y, unsigned char format=PIXFMT_RGB565, unsigned char npages=1, bool shadow=false);
+unsigned char initFile(const char *path, unsigned short int x, unsigned short int y, unsigned char format=PIXFMT_RGB565, bool shadow=false);
 void drawRect(unsigned short int x1, unsigned short int y1, unsigned short int x2, unsigned short int y2);
 void drawRoundRect(unsigned short int x1, unsigned short int y1, unsigned short int x2, unsigned short int y2);
+void drawRoundRect(unsigned short int x1, unsigned short int y1, unsigned short int x2, unsigned short int y2, unsigned short int radius);
 void fillRect(unsigned short int x1, unsigned short int y1, unsigned short int x2, unsigned short int y2);
 void fillRoundRect(unsigned short int x1, unsigned short int y1, unsigned short int x2, unsigned short int y2);
+void fillRoundRect(unsigned short int x1, unsigned short int y1, unsigned short int x2, unsigned short int y2, unsigned short int radius);
 void drawCircle(unsigned short int x, unsigned short int y, unsigned short int radius);
 void fillCircle(unsigned short int x, unsigned short int y, unsigned short int radius);
+void drawEllipse(unsigned short int x, unsigned short int y, unsigned short int rx, unsigned short int ry);
+void fillEllipse(unsigned short int x, unsigned short int y, unsigned short int rx, unsigned short int ry);
+void fillTriangle(unsigned short int x1, unsigned short int y1, unsigned short int x2, unsigned short int y2, unsigned short int x3, unsigned short int y3);
+void fillPolygon(const _point *points, unsigned short int n, unsigned char rule=FILL_EVENODD);
+void fillPie(unsigned short int x, unsigned short int y, unsigned short int radius, unsigned short int start, unsigned short int end);
+void fillArc(unsigned short int x, unsigned short int y, unsigned short int radius, unsigned short int width, unsigned short int start, unsigned short int end);
 void clrScr();
 void fillScr(unsigned char r, unsigned char g, unsigned char b);
 void fillScr(unsigned short int color);
@@ -91,23 +688,94 @@ unsigned short int getBackColor();
 void drawPixel(unsigned short int x, unsigned short int y);
 void drawPixel(unsigned short int x, unsigned short int y, unsigned short int color);
 void drawLine(unsigned short int x1, unsigned short int y1, unsigned short int x2, unsigned short int y2);
+void drawLineAA(unsigned short int x1, unsigned short int y1, unsigned short int x2, unsigned short int y2);
+void drawCircleAA(unsigned short int x, unsigned short int y, unsigned short int radius);
+void drawArcAA(unsigned short int x, unsigned short int y, unsigned short int radius, unsigned short int start, unsigned short int end);
 void drawHLine(unsigned short int x, unsigned short int y, short int l);
 void drawVLine(unsigned short int x, unsigned short int y, short int l);
 void printChar(unsigned char c, unsigned short int x, unsigned short int y);
 void rotateChar(unsigned char c, unsigned short x, unsigned short y, int pos, unsigned short deg);
 void print(char *st, unsigned short int x, unsigned short int y, unsigned short int deg=0);
+int getTextWidth(const char *st);
+void printBox(const char *st, unsigned short int x1, unsigned short int y1, unsigned short int x2, unsigned short int y2, unsigned char flags=TEXT_WRAP);
+void measureText(const char *st, unsigned short int width, _text_size *size);
+void clearTextCache();
 void printNumI(long num, unsigned short int x, unsigned short int y, unsigned char length=0, char filler=' ');
 void printNumF(float num, unsigned char dec, unsigned short int x, unsigned short int y, char divider='.', unsigned short int length=0, char filler=' ');
+void initField(_numfield *field, unsigned short int x, unsigned short int y, unsigned char length=0, char filler=' ', char divider='.');
+void resetField(_numfield *field);
+void printNumI(_numfield *field, long num);
+void printNumF(_numfield *field, float num, unsigned char dec);
 void setFont(const unsigned char* font, bool transparent=false);
+void setFont(const _font *font, bool transparent=false);
+static const _font* loadFont(const char *path, const char *name=NULL);
+static const _font* findFont(const char *name);
+static const _font* registerFont(const char *name, const unsigned char *font, const _span_font *spans=NULL);
 const unsigned char* getFont();
 unsigned char getFontXsize();
 unsigned char getFontYsize();
+unsigned long getGlyphHits();
+unsigned long getGlyphMisses();
+void clearGlyphCache();
 void drawBitmap(unsigned short int x, unsigned short int y, unsigned short int sx, unsigned short int sy, bitmapdatatype data);
+void drawBitmap(unsigned short int x, unsigned short int y, unsigned short int sx, unsigned short int sy, bitmapdatatype data, unsigned int stride);
 void drawBitmap(unsigned short int x, unsigned short int y, unsigned short int sx, unsigned short int sy, bitmapdatatype data, unsigned short int deg, unsigned short int rox, unsigned short int roy);
+void drawBitmap(unsigned short int x, unsigned short int y, RTFT &src, unsigned short int x1, unsigned short int y1, unsigned short int x2, unsigned short int y2);
+void setColorKey(unsigned int color);
+unsigned int getColorKey();
+void setAlpha(unsigned char alpha);
+unsigned char getAlpha();
+void fillMask(unsigned short int x, unsigned short int y, unsigned short int sx, unsigned short int sy, const unsigned char *mask);
+void drawBitmapMask(unsigned short int x, unsigned short int y, unsigned short int sx, unsigned short int sy, bitmapdatatype data, const unsigned char *mask);
+void setRotateFilter(unsigned char filter);
 int getDisplayXSize();
 int getDisplayYSize();
+void pushClip(unsigned short int x1, unsigned short int y1, unsigned short int x2, unsigned short int y2);
+void pushViewport(unsigned short int x1, unsigned short int y1, unsigned short int x2, unsigned short int y2);
+void popClip();
+void popViewport();
+void resetClip();
+const _clip* getClip();
 void setDisplayPage(unsigned char page);
 void setWritePage(unsigned char page);
+unsigned char getDisplayPage();
+unsigned char getWritePage();
+unsigned char getPageCount();
+void present();
+unsigned char getDamageCount();
+const _rect* getDamage();
+long int getDamageArea();
+void clearDamage();
+void beginList(RTFTList *list);
+void endList();
+void drawList(RTFTList *list);
+bool setThreads(unsigned char n);
+unsigned char getThreads();
+void setFrameRate(unsigned char fps);
+void setVsync(bool enable);
+bool getVsync();
+unsigned long getFrameCount();
+unsigned long getMissedFrames();
+bool getFrameStats(unsigned char ago, _frame_stats *st);
+float getFps();
+bool getPrimitiveStats(unsigned char id, _prim_stats *st);
+void resetPrimitiveStats();
+bool setStatsDump(const char *path, unsigned int frames);
+void dumpStats();
+unsigned char getPixelFormat();
+const _surface* getSurface();
+const char* getPixels();
+bool saveScreen(const char *path);
+bool startCapture(const char *path, unsigned char mode=CAPTURE_DELTA);
+bool startCapture(int fd, unsigned char mode=CAPTURE_DELTA);
+void stopCapture();
+unsigned long getCaptureFrames();
+unsigned long getCaptureDropped();
+bool startServer(const char *path, unsigned char fps=REMOTE_FPS);
+bool startServer(unsigned short int port, unsigned char fps=REMOTE_FPS);
+void stopServer();
+unsigned char getServerClients();
+static const char* getSpanKernel();
 void _convert_float(char *buf, float num, unsigned short int width, unsigned char prec);
 };
 
@@ -0,0 +1,685 @@
+/*
+  bench.cpp - Micro benchmarks for the RTFT library.
+  Copyright (C)2015 Daniel Donantueno. All right reserved
+
+  Runs every RTFT primitive across a range of sizes, fonts and colors
+  on an off-screen surface and reports ns per call, Mpixels/s and CPU
+  cycles per pixel. The pixel counts are the nominal ones of each call
+  (w*h for a box, the length of a line, ...).
+
+  Build:  g++ -O2 -pthread -I. bench.cpp RTFT.cpp -o bench
+  Usage:  bench [-json] [-demo] [-format n] [-size WxH] [-time ms]
+          -json    machine readable output, to diff runs
+          -demo    also replay the demo.cpp scenes as a macro benchmark
+          -format  PIXFMT_ value of the surface, RGB565 by default
+          -size    surface size, 800x480 by default
+          -time    time spent on every case, 200 ms by default
+
+  Repository https://github.com/dhdonantueno/RTFT.git
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the CC BY-NC-SA 3.0 license.
+  Please see the included documents for further information.
+*/
+
+#include <RTFT.h>
+#include <stdint.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+
+RTFT* myGLCD;
+int W = 800, H = 480;
+bool json = false;
+int results = 0;
+long long budget_ns = 200000000LL;
+int cycles_fd = -1;
+
+static const unsigned short palette[8] = {
+	VGA_RED, VGA_GREEN, VGA_BLUE, VGA_WHITE, VGA_YELLOW, VGA_AQUA, VGA_FUCHSIA, VGA_GRAY
+};
+static const unsigned char *fonts[3] = { SmallFont, BigFont, SevenSegNumFont };
+static const char *font_names[3] = { "SmallFont", "BigFont", "SevenSegNumFont" };
+static unsigned short bitmap[256*256];
+static unsigned char mask[256*256];
+
+long long now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// CPU cycles of this thread, -1 when the kernel does not give them.
+void openCycles() {
+	struct perf_event_attr pe;
+	memset(&pe, 0, sizeof(pe));
+	pe.type = PERF_TYPE_HARDWARE;
+	pe.size = sizeof(pe);
+	pe.config = PERF_COUNT_HW_CPU_CYCLES;
+	pe.exclude_kernel = 1;
+	pe.exclude_hv = 1;
+	cycles_fd = syscall(__NR_perf_event_open, &pe, 0, -1, -1, 0);
+}
+
+long long cycles() {
+	long long c;
+	if (cycles_fd<0 || read(cycles_fd, &c, sizeof(c))!=sizeof(c))
+		return -1;
+	return c;
+}
+
+// Positions walk the screen so calls do not hit the same cache lines.
+int px(int i, int size) {
+	return size<W ? (i * 37) % (W - size) : 0;
+}
+
+int py(int i, int size) {
+	return size<H ? (i * 53) % (H - size) : 0;
+}
+
+void fillRect(int i, int s) {
+	myGLCD->setColor(palette[i & 7]);
+	myGLCD->fillRect(px(i, s), py(i, s), px(i, s) + s - 1, py(i, s) + s - 1);
+}
+
+void drawRect(int i, int s) {
+	myGLCD->setColor(palette[i & 7]);
+	myGLCD->drawRect(px(i, s), py(i, s), px(i, s) + s - 1, py(i, s) + s - 1);
+}
+
+void fillRoundRect(int i, int s) {
+	myGLCD->setColor(palette[i & 7]);
+	myGLCD->fillRoundRect(px(i, s), py(i, s), px(i, s) + s - 1, py(i, s) + s - 1);
+}
+
+void drawRoundRect(int i, int s) {
+	myGLCD->setColor(palette[i & 7]);
+	myGLCD->drawRoundRect(px(i, s), py(i, s), px(i, s) + s - 1, py(i, s) + s - 1);
+}
+
+// Corners of a quarter of the size.
+void fillRoundRectR(int i, int s) {
+	myGLCD->setColor(palette[i & 7]);
+	myGLCD->fillRoundRect(px(i, s), py(i, s), px(i, s) + s - 1, py(i, s) + s - 1, s / 4);
+}
+
+// Lines of length s in 16 directions around a point.
+void drawLine(int i, int s) {
+	static const signed char dir[16][2] = {
+		{16,0}, {15,6}, {11,11}, {6,15}, {0,16}, {-6,15}, {-11,11}, {-15,6},
+		{-16,0}, {-15,-6}, {-11,-11}, {-6,-15}, {0,-16}, {6,-15}, {11,-11}, {15,-6}
+	};
+	int x = s + px(i, 2*s), y = s + py(i, 2*s);
+	myGLCD->setColor(palette[i & 7]);
+	myGLCD->drawLine(x, y, x + dir[i & 15][0] * (s - 1) / 16, y + dir[i & 15][1] * (s - 1) / 16);
+}
+
+void drawLineAA(int i, int s) {
+	static const signed char dir[8][2] = {
+		{15,6}, {6,15}, {-6,15}, {-15,6}, {-15,-6}, {-6,-15}, {6,-15}, {15,-6}
+	};
+	int x = s + px(i, 2*s), y = s + py(i, 2*s);
+	myGLCD->setColor(palette[i & 7]);
+	myGLCD->drawLineAA(x, y, x + dir[i & 7][0] * (s - 1) / 16, y + dir[i & 7][1] * (s - 1) / 16);
+}
+
+void drawHLine(int i, int s) {
+	myGLCD->setColor(palette[i & 7]);
+	myGLCD->drawHLine(px(i, s), py(i, 1), s - 1);
+}
+
+void drawVLine(int i, int s) {
+	myGLCD->setColor(palette[i & 7]);
+	myGLCD->drawVLine(px(i, 1), py(i, s), s - 1);
+}
+
+void drawCircle(int i, int s) {
+	myGLCD->setColor(palette[i & 7]);
+	myGLCD->drawCircle(s + px(i, 2*s+1), s + py(i, 2*s+1), s);
+}
+
+void drawCircleAA(int i, int s) {
+	myGLCD->setColor(palette[i & 7]);
+	myGLCD->drawCircleAA(s + px(i, 2*s+3), s + py(i, 2*s+3), s);
+}
+
+void fillCircle(int i, int s) {
+	myGLCD->setColor(palette[i & 7]);
+	myGLCD->fillCircle(s + px(i, 2*s+1), s + py(i, 2*s+1), s);
+}
+
+// Ellipses twice as wide as high.
+void drawEllipse(int i, int s) {
+	myGLCD->setColor(palette[i & 7]);
+	myGLCD->drawEllipse(s + px(i, 2*s+1), s/2 + py(i, s+1), s, s/2);
+}
+
+void fillEllipse(int i, int s) {
+	myGLCD->setColor(palette[i & 7]);
+	myGLCD->fillEllipse(s + px(i, 2*s+1), s/2 + py(i, s+1), s, s/2);
+}
+
+void fillTriangle(int i, int s) {
+	int x = px(i, s), y = py(i, s);
+	myGLCD->setColor(palette[i & 7]);
+	myGLCD->fillTriangle(x + (i & 1 ? s : 0), y, x, y + s, x + s, y + s / 2);
+}
+
+// A 5 pointed star of 10 points filling an s box.
+void fillPolygon(int i, int s) {
+	static const signed char star[10][2] = {
+		{0,-64}, {15,-21}, {61,-20}, {24,7}, {38,52}, {0,25}, {-38,52}, {-24,7}, 
+		{-61,-20}, {-15,-21}
+	};
+	_point p[10];
+	int x = s / 2 + px(i, s), y = s / 2 + py(i, s);
+	for (int k=0; k<10; k++) {
+		p[k].x = x + star[k][0] * (s - 1) / 128;
+		p[k].y = y + star[k][1] * (s - 1) / 128;
+	}
+	myGLCD->setColor(palette[i & 7]);
+	myGLCD->fillPolygon(p, 10);
+}
+
+void fillPie(int i, int s) {
+	myGLCD->setColor(palette[i & 7]);
+	myGLCD->fillPie(s + px(i, 2*s+1), s + py(i, 2*s+1), s, (i * 45) % 360, (i * 45 + 270) % 360);
+}
+
+void drawPixel(int i, int) {
+	myGLCD->drawPixel(px(i * 7, 1), py(i * 11, 1), palette[i & 7]);
+}
+
+// s is the font index, times 2 plus 1 for transparent text.
+void printChar(int i, int s) {
+	const unsigned char *font = fonts[s >> 1];
+	myGLCD->setFont(font, s & 1);
+	myGLCD->setColor(palette[i & 7]);
+	myGLCD->printChar(font[2] + i % font[3], px(i, font[0]), py(i, font[1]));
+}
+
+void print(int i, int s) {
+	myGLCD->setFont(fonts[s >> 1], s & 1);
+	myGLCD->setColor(palette[i & 7]);
+	myGLCD->print((char*)"0123456789ABCDEF", px(i, 16 * fonts[s >> 1][0]), py(i, fonts[s >> 1][1]));
+}
+
+void rotateChar(int i, int s) {
+	const unsigned char *font = fonts[s >> 1];
+	myGLCD->setFont(font, s & 1);
+	myGLCD->setColor(palette[i & 7]);
+	myGLCD->rotateChar(font[2] + i % font[3], 2*font[1] + px(i, 4*font[1]),
+		2*font[1] + py(i, 4*font[1]), 0, (i * 7) % 360);
+}
+
+void printNumI(int i, int s) {
+	const unsigned char *font = fonts[s >> 1];
+	myGLCD->setFont(font, s & 1);
+	myGLCD->setColor(VGA_WHITE);
+	myGLCD->printNumI(i, px(i, 6 * font[0]), py(i, font[1]), 6, '0');
+}
+
+static const char *alarms[8] = {
+	"Alarm 1: boiler pressure above 12 bar, check relief valve 3 and feed pump",
+	"Alarm 2: tank 4 level low, refill before 18:00",
+	"Alarm 3: conveyor B stopped\nMotor overload tripped",
+	"Alarm 4: door 7 open for more than 5 minutes",
+	"Alarm 5: 380 V supply phase L2 missing, running on generator since 06:12",
+	"Alarm 6: filter 2 differential pressure high",
+	"Alarm 7: cooling water 41 C, limit 35 C",
+	"Alarm 8: communication lost with PLC 2 at 10.0.0.12",
+};
+
+// 64 six digit fields counting up, most calls redraw one character.
+static _numfield fields[64];
+static int fields_font = -1;
+
+void printNumField(int i, int s) {
+	const unsigned char *font = fonts[s >> 1];
+	myGLCD->setFont(font, s & 1);
+	myGLCD->setColor(VGA_WHITE);
+	if (fields_font!=s) {
+		for (int k=0; k<64; k++)
+			myGLCD->initField(&fields[k], px(k, 6 * font[0]), py(k, font[1]), 6, '0');
+		fields_font = s;
+	}
+	myGLCD->printNumI(&fields[i & 63], i >> 6);
+}
+
+// 8 alarm paragraphs wrapped in boxes of 30 by 4 characters, the same
+// label in the same box every 8 calls.
+void printBox(int i, int s) {
+	const unsigned char *font = fonts[s >> 1];
+	int w = 30 * font[0], h = 4 * font[1];
+	myGLCD->setFont(font, s & 1);
+	myGLCD->setColor(palette[i & 7]);
+	myGLCD->printBox(alarms[i & 7], px(i & 7, w), py(i & 7, h), px(i & 7, w) + w - 1,
+		py(i & 7, h) + h - 1, TEXT_WRAP | TEXT_ELLIPSIS);
+}
+
+void drawBitmap(int i, int s) {
+	myGLCD->drawBitmap(px(i, s), py(i, s), s, s, bitmap + (i & 15), 256);
+}
+
+void drawBitmapKey(int i, int s) {
+	myGLCD->setColorKey(bitmap[0]);
+	myGLCD->drawBitmap(px(i, s), py(i, s), s, s, bitmap + (i & 15), 256);
+	myGLCD->setColorKey(VGA_TRANSPARENT);
+}
+
+void rotateBitmap(int i, int s) {
+	myGLCD->drawBitmap(s + px(i, 3*s), s + py(i, 3*s), s, s, bitmap,
+		1 + (i * 7) % 359, s/2, s/2);
+}
+
+// Translucent versions at alpha 128, mask rows are 256 wide.
+void fillRectAlpha(int i, int s) {
+	myGLCD->setAlpha(128);
+	fillRect(i, s);
+	myGLCD->setAlpha(255);
+}
+
+void fillMask(int i, int s) {
+	myGLCD->setColor(palette[i & 7]);
+	for (int row=0; row<s; row++)
+		myGLCD->fillMask(px(i, s), py(i, s) + row, s, 1, mask + row * 256 + (i & 15));
+}
+
+void drawBitmapAlpha(int i, int s) {
+	myGLCD->setAlpha(128);
+	drawBitmap(i, s);
+	myGLCD->setAlpha(255);
+}
+
+void fillScr(int i, int) {
+	myGLCD->fillScr(palette[i & 7]);
+}
+
+// Runs fn until the time budget is spent and reports the rate.
+void bench(const char *name, const char *size, long pixels, void (*fn)(int, int), int p) {
+	long long calls = 0, ns, cyc, start, cstart;
+	int batch = 1;
+
+	// warm up caches, glyph cache and page faults
+	for (int i=0; i<64; i++)
+		fn(i, p);
+	myGLCD->clearDamage();
+
+	start = now();
+	cstart = cycles();
+	do {
+		for (int i=0; i<batch; i++)
+			fn(calls + i, p);
+		calls += batch;
+		myGLCD->clearDamage();
+		if (batch<4096)
+			batch *= 2;
+		ns = now() - start;
+	} while (ns<budget_ns);
+	cyc = cstart<0 ? -1 : cycles() - cstart;
+
+	double ns_call = (double)ns / calls;
+	double mpix = pixels * calls * 1000.0 / ns;
+	double cpp = cyc<0 ? -1 : (double)cyc / (pixels * calls);
+	if (json) {
+		printf("%s\n    {\"name\": \"%s\", \"size\": \"%s\", \"pixels\": %ld, \"calls\": %lld, "
+			"\"ns_per_call\": %.1f, \"mpix_per_s\": %.2f, ", results ? "," : "",
+			name, size, pixels, calls, ns_call, mpix);
+		if (cpp<0)
+			printf("\"cycles_per_pixel\": null}");
+		else
+			printf("\"cycles_per_pixel\": %.3f}", cpp);
+	} else {
+		printf("%-16s %-22s %10.1f ns %10.2f Mpix/s", name, size, ns_call, mpix);
+		if (cpp<0)
+			printf("          - cyc/pix\n");
+		else
+			printf(" %10.3f cyc/pix\n", cpp);
+	}
+	results++;
+}
+
+void sizes(const char *name, void (*fn)(int, int), long (*pixels)(int), int max=400) {
+	static const int sz[] = { 1, 8, 32, 128, 400 };
+	char size[32];
+
+	for (unsigned i=0; i<sizeof(sz)/sizeof(sz[0]); i++) {
+		if (sz[i]>W || sz[i]>H || sz[i]>max)
+			continue;
+		sprintf(size, "%d", sz[i]);
+		bench(name, size, pixels(sz[i]), fn, sz[i]);
+	}
+}
+
+long area(int s) { return (long)s * s; }
+long outline(int s) { return s>1 ? 4L * s - 4 : 1; }
+long length(int s) { return s; }
+long circle(int s) { return s ? (long)(2 * M_PI * s) : 1; }
+long disc(int s) { return (long)(M_PI * s * s) + 1; }
+long ellipse(int s) { return s ? (long)(M_PI * 0.75 * 2 * s) : 1; }
+long oval(int s) { return (long)(M_PI * s * s / 2) + 1; }
+long triangle(int s) { return (long)s * s / 2 + 1; }
+long star(int s) { return (long)s * s * 3 / 10 + 1; }
+long pie(int s) { return (long)(M_PI * s * s * 3 / 4) + 1; }
+
+void texts() {
+	char size[32];
+
+	for (int f=0; f<3; f++)
+		for (int t=0; t<2; t++) {
+			long pixels = fonts[f][0] * fonts[f][1];
+			sprintf(size, "%s%s", font_names[f], t ? "/transparent" : "");
+			bench("printChar", size, pixels, printChar, f*2 + t);
+			bench("print16", size, 16 * pixels, print, f*2 + t);
+			bench("rotateChar", size, pixels, rotateChar, f*2 + t);
+			bench("printNumI6", size, 6 * pixels, printNumI, f*2 + t);
+			bench("numField6", size, 6 * pixels, printNumField, f*2 + t);
+			bench("printBox", size, 120 * pixels, printBox, f*2 + t);
+		}
+}
+
+//*********************************
+// DEMO REPLAY
+//*********************************
+// The scenes of demo.cpp without the sleeps, on the same 800x480
+// layout, with a fixed random seed.
+
+void sceneFrame() {
+	myGLCD->clrScr();
+	myGLCD->setColor(255, 0, 0);
+	myGLCD->fillRect(0, 0, 799, 13);
+	myGLCD->setColor(64, 64, 64);
+	myGLCD->fillRect(0, 466, 799, 479);
+	myGLCD->setColor(255, 255, 255);
+	myGLCD->setBackColor(255, 0, 0);
+	myGLCD->print((char*)"* Raspberry Pi Display Library UTFT compatible *", CENTER, 1);
+	myGLCD->setBackColor(64, 64, 64);
+	myGLCD->setColor(255,255,0);
+	myGLCD->print((char*)"<http://GESTION-E.com.ar>", CENTER, 467);
+	myGLCD->setColor(0, 0, 255);
+	myGLCD->drawRect(0, 14, 799, 465);
+}
+
+void sceneCurves() {
+	myGLCD->setColor(0, 0, 255);
+	myGLCD->setBackColor(0, 0, 0);
+	myGLCD->drawLine(399, 15, 399, 464);
+	myGLCD->drawLine(1, 239, 798, 239);
+	for (int i=9; i<790; i+=10)
+		myGLCD->drawLine(i, 237, i, 242);
+	for (int i=19; i<470; i+=10)
+		myGLCD->drawLine(397, i, 402, i);
+	myGLCD->setColor(0,255,255);
+	myGLCD->print((char*)"Sin", 5, 15);
+	for (int i=1; i<798; i++)
+		myGLCD->drawPixel(i,239+(sin(((i*1.13)*3.14)/180)*200));
+	myGLCD->setColor(255,0,0);
+	myGLCD->print((char*)"Cos", 5, 27);
+	for (int i=1; i<798; i++)
+		myGLCD->drawPixel(i,239+(cos(((i*1.13)*3.14)/180)*200));
+	myGLCD->setColor(255,255,0);
+	myGLCD->print((char*)"Tan", 5, 39);
+	for (int i=1; i<798; i++)
+		myGLCD->drawPixel(i,239+(int)(tan(((i*1.13)*3.14)/180))%200);
+}
+
+void sceneSine() {
+	int buf[798];
+	int x = 1, y;
+
+	myGLCD->setColor(0,0,0);
+	myGLCD->fillRect(1,15,798,464);
+	myGLCD->setColor(0, 0, 255);
+	myGLCD->setBackColor(0, 0, 0);
+	myGLCD->drawLine(399, 15, 399, 464);
+	myGLCD->drawLine(1, 239, 798, 239);
+	for (int i=1; i<(798*20); i++) {
+		x++;
+		if (x==799)
+			x=1;
+		if (i>799) {
+			if ((x==399)||(buf[x-1]==239))
+				myGLCD->setColor(0,0,255);
+			else
+				myGLCD->setColor(0,0,0);
+			myGLCD->drawPixel(x,buf[x-1]);
+		}
+		myGLCD->setColor(0,255,255);
+		y=239+(sin(((i*1.65)*3.14)/180)*(200-(i / 100)));
+		myGLCD->drawPixel(x,y);
+		buf[x-1]=y;
+	}
+}
+
+void clearArea() {
+	myGLCD->setColor(0,0,0);
+	myGLCD->fillRect(1,15,798,464);
+}
+
+void sceneFillRects() {
+	clearArea();
+	for (int i=0; i<50; i++) {
+		myGLCD->setColor(rand()%255, rand()%255, rand()%255);
+		int x=2+rand()%746, y=16+rand()%397;
+		myGLCD->fillRect(x, y, x+50, y+50);
+	}
+}
+
+void sceneFillRoundRects() {
+	clearArea();
+	for (int i=0; i<50; i++) {
+		myGLCD->setColor(rand()%255, rand()%255, rand()%255);
+		int x=2+rand()%746, y=16+rand()%397;
+		myGLCD->fillRoundRect(x, y, x+50, y+50);
+	}
+}
+
+void sceneFillCircles() {
+	clearArea();
+	for (int i=0; i<50; i++) {
+		myGLCD->setColor(rand()%255, rand()%255, rand()%255);
+		myGLCD->fillCircle(27+rand()%746, 41+rand()%397, 25);
+	}
+}
+
+void sceneLinePattern() {
+	clearArea();
+	myGLCD->setColor (255,0,0);
+	for (int i=15; i<463; i+=5)
+		myGLCD->drawLine(1, i, (i*1.66)-10, 463);
+	for (int i=463; i>15; i-=5)
+		myGLCD->drawLine(798, i, (short int)((i*1.66)+30), 15);
+	myGLCD->setColor (0,255,255);
+	for (int i=463; i>15; i-=5)
+		myGLCD->drawLine(1, i, (int)(770-(i*1.66)), 15);
+	for (int i=15; i<463; i+=5)
+		myGLCD->drawLine(798, i, (int)(810-(i*1.66)), 463);
+}
+
+void sceneCircles() {
+	clearArea();
+	for (int i=0; i<250; i++) {
+		myGLCD->setColor(rand()%255, rand()%255, rand()%255);
+		int x=32+rand()%736, y=45+rand()%386;
+		myGLCD->drawCircle(x, y, rand()%30);
+	}
+}
+
+void sceneRects() {
+	clearArea();
+	for (int i=0; i<250; i++) {
+		myGLCD->setColor(rand()%255, rand()%255, rand()%255);
+		int x=2+rand()%796, y=16+rand()%447, x2=2+rand()%796, y2=16+rand()%447;
+		myGLCD->drawRect(x, y, x2, y2);
+	}
+}
+
+void sceneRoundRects() {
+	clearArea();
+	for (int i=0; i<250; i++) {
+		myGLCD->setColor(rand()%255, rand()%255, rand()%255);
+		int x=2+rand()%796, y=16+rand()%447, x2=2+rand()%796, y2=16+rand()%447;
+		myGLCD->drawRoundRect(x, y, x2, y2);
+	}
+}
+
+void sceneLines() {
+	clearArea();
+	for (int i=0; i<250; i++) {
+		myGLCD->setColor(rand()%255, rand()%255, rand()%255);
+		int x=2+rand()%796, y=16+rand()%447, x2=2+rand()%796, y2=16+rand()%447;
+		myGLCD->drawLine(x, y, x2, y2);
+	}
+}
+
+void scenePixels() {
+	clearArea();
+	for (int i=0; i<10000; i++) {
+		myGLCD->setColor(rand()%255, rand()%255, rand()%255);
+		myGLCD->drawPixel(2+rand()%796, 16+rand()%447);
+	}
+}
+
+void sceneEnd() {
+	myGLCD->fillScr(0, 0, 255);
+	myGLCD->setColor(255, 0, 0);
+	myGLCD->fillRoundRect(320, 190, 479, 289);
+	myGLCD->setColor(255, 255, 255);
+	myGLCD->setBackColor(255, 0, 0);
+	myGLCD->print((char*)"That's it!", CENTER, 213);
+	myGLCD->print((char*)"Restarting in", CENTER, 239);
+	myGLCD->print((char*)"ten seconds...", CENTER, 252);
+	myGLCD->setColor(0, 255, 0);
+	myGLCD->setBackColor(0, 0, 255);
+	myGLCD->print((char*)"Runtime: (seconds)", CENTER, 450);
+	myGLCD->printNumI(0, CENTER, 465);
+}
+
+struct scene {
+	const char *name;
+	void (*fn)();
+};
+
+static const scene scenes[] = {
+	{ "frame", sceneFrame }, { "curves", sceneCurves }, { "sinewave", sceneSine },
+	{ "fillRects", sceneFillRects }, { "fillRoundRects", sceneFillRoundRects },
+	{ "fillCircles", sceneFillCircles }, { "linePattern", sceneLinePattern },
+	{ "circles", sceneCircles }, { "rects", sceneRects },
+	{ "roundRects", sceneRoundRects }, { "lines", sceneLines },
+	{ "pixels", scenePixels }, { "end", sceneEnd }
+};
+
+void demo() {
+	const int rounds = 20;
+	int n = sizeof(scenes) / sizeof(scenes[0]);
+	long long total = 0;
+
+	RTFT *screen = myGLCD;
+	myGLCD = new RTFT();
+	if (myGLCD->initMemory(800, 480, screen->getPixelFormat(), 2)) {
+		fprintf(stderr, "bench: cannot create the demo surface\n");
+		exit(1);
+	}
+	myGLCD->setFont(SmallFont);
+	if (json)
+		printf(",\n  \"demo\": [");
+	else
+		printf("\ndemo replay, us per scene averaged over %d rounds\n", rounds);
+
+	for (int s=0; s<n; s++) {
+		srand(1);
+		long long start = now();
+		for (int r=0; r<rounds; r++) {
+			scenes[s].fn();
+			myGLCD->present();
+		}
+		long long ns = (now() - start) / rounds;
+		total += ns;
+		if (json)
+			printf("%s\n    {\"scene\": \"%s\", \"us\": %.1f}", s ? "," : "", scenes[s].name, ns / 1000.0);
+		else
+			printf("%-16s %12.1f us\n", scenes[s].name, ns / 1000.0);
+	}
+	if (json)
+		printf("\n  ],\n  \"demo_total_us\": %.1f", total / 1000.0);
+	else
+		printf("%-16s %12.1f us\n", "total", total / 1000.0);
+
+	delete myGLCD;
+	myGLCD = screen;
+}
+
+int main(int argc, char* argv[])
+{
+	bool replay = false;
+	int format = PIXFMT_RGB565;
+
+	for (int i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "-json"))
+			json = true;
+		else if (!strcmp(argv[i], "-demo"))
+			replay = true;
+		else if (!strcmp(argv[i], "-format") && i+1<argc)
+			format = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-size") && i+1<argc)
+			sscanf(argv[++i], "%dx%d", &W, &H);
+		else if (!strcmp(argv[i], "-time") && i+1<argc)
+			budget_ns = atol(argv[++i]) * 1000000LL;
+		else {
+			fprintf(stderr, "usage: %s [-json] [-demo] [-format n] [-size WxH] [-time ms]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	myGLCD = new RTFT();
+	if (myGLCD->initMemory(W, H, format))
+		return 1;
+	srand(1);
+	for (int i=0; i<256*256; i++)
+		bitmap[i] = rand();
+	for (int i=0; i<256*256; i++)
+		mask[i] = rand();
+	openCycles();
+
+	if (json)
+		printf("{\n  \"kernel\": \"%s\",\n  \"format\": %d,\n  \"width\": %d,\n  \"height\": %d,\n"
+			"  \"results\": [", RTFT::getSpanKernel(), format, W, H);
+	else
+		printf("span kernel %s, format %d, %dx%d\n", RTFT::getSpanKernel(), format, W, H);
+
+	sizes("fillRect", fillRect, area);
+	sizes("drawRect", drawRect, outline);
+	sizes("fillRoundRect", fillRoundRect, area);
+	sizes("drawRoundRect", drawRoundRect, outline);
+	sizes("fillRoundRectR", fillRoundRectR, area);
+	sizes("drawLine", drawLine, length);
+	sizes("drawLineAA", drawLineAA, length);
+	sizes("drawHLine", drawHLine, length);
+	sizes("drawVLine", drawVLine, length);
+	sizes("drawCircle", drawCircle, circle);
+	sizes("drawCircleAA", drawCircleAA, circle);
+	sizes("fillCircle", fillCircle, disc);
+	sizes("drawEllipse", drawEllipse, ellipse);
+	sizes("fillEllipse", fillEllipse, oval);
+	sizes("fillTriangle", fillTriangle, triangle);
+	sizes("fillPolygon", fillPolygon, star);
+	sizes("fillPie", fillPie, pie);
+	bench("drawPixel", "1", 1, drawPixel, 0);
+	texts();
+	sizes("drawBitmap", drawBitmap, area, 240);
+	sizes("drawBitmapKey", drawBitmapKey, area, 240);
+	sizes("rotateBitmap", rotateBitmap, area, 240);
+	sizes("fillRectAlpha", fillRectAlpha, area);
+	sizes("fillMask", fillMask, area, 240);
+	sizes("drawBitmapAlpha", drawBitmapAlpha, area, 240);
+	bench("fillScr", "screen", (long)W * H, fillScr, 0);
+
+	if (json)
+		printf("\n  ]");
+	if (replay)
+		demo();
+	if (json)
+		printf("\n}\n");
+
+	delete myGLCD;
+	return 0;
+}
@@ -0,0 +1,300 @@
+/*
+  fontconv.cpp - Converts BDF fonts to RTFT proportional fonts.
+  Copyright (C)2015 Daniel Donantueno. All right reserved
+
+  Reads a BDF bitmap font, as X11 and most font editors write them, and
+  writes its glyphs in the proportional format of RTFT.h, either as a
+  file for RTFT::loadFont() or as a C array like the ones of
+  DefaultFonts.c for RTFT::setFont(). BDF has no kerning, the pairs come
+  from a text file of lines "left right adjust", code points in hex and
+  the change of the advance in pixels.
+
+  Build:  g++ -O2 -I. fontconv.cpp -o fontconv
+  Usage:  fontconv [-range first-last] [-kern file] [-c name] font.bdf out
+          -range  only code points first to last, in hex, may repeat
+          -kern   file of kerning pairs
+          -c      write a C array called name instead of a font file
+
+  Repository https://github.com/dhdonantueno/RTFT.git
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the CC BY-NC-SA 3.0 license.
+  Please see the included documents for further information.
+*/
+
+#include <RTFT.h>
+
+struct glyph {
+	unsigned int code;
+	int width;
+	int left;
+	int advance;
+	unsigned char *rows;
+};
+
+struct pair {
+	int left;
+	int right;
+	int adjust;
+};
+
+glyph *glyphs = NULL;
+int count = 0;
+unsigned int ranges[64][2];
+int nranges = 0;
+
+bool wanted(unsigned int code) {
+	if (!nranges)
+		return true;
+	for (int i=0; i<nranges; i++)
+		if (code>=ranges[i][0] && code<=ranges[i][1])
+			return true;
+	return false;
+}
+
+int byCode(const void *a, const void *b) {
+	unsigned int x = ((const glyph*)a)->code, y = ((const glyph*)b)->code;
+	return x<y ? -1 : x>y;
+}
+
+int byGlyphs(const void *a, const void *b) {
+	const pair *x = (const pair*)a, *y = (const pair*)b;
+	return x->left!=y->left ? x->left - y->left : x->right - y->right;
+}
+
+int findGlyph(unsigned int code) {
+	glyph key;
+	key.code = code;
+	glyph *g = (glyph*)bsearch(&key, glyphs, count, sizeof(glyph), byCode);
+	return g ? g - glyphs : -1;
+}
+
+// Reads the glyphs of a BDF font with rows placed in a box of ascent +
+// descent rows, false when it is not one.
+bool readBDF(const char *path, int &ascent, int &descent) {
+	FILE *f = fopen(path, "r");
+	char line[1024];
+	int bw = 0, bh = 0, bx = 0, by = 0, code = -1, advance = 0;
+	bool font = false;
+
+	if (!f) {
+		perror(path);
+		return false;
+	}
+	ascent = descent = -1;
+	while (fgets(line, sizeof(line), f)) {
+		int a, b, c, d;
+		if (!strncmp(line, "STARTFONT", 9))
+			font = true;
+		else if (sscanf(line, "FONTBOUNDINGBOX %d %d %d %d", &a, &b, &c, &d)==4) {
+			if (ascent<0) ascent = b + d;
+			if (descent<0) descent = -d;
+		} else if (sscanf(line, "FONT_ASCENT %d", &a)==1)
+			ascent = a;
+		else if (sscanf(line, "FONT_DESCENT %d", &a)==1)
+			descent = a;
+		else if (sscanf(line, "ENCODING %d", &a)==1)
+			code = a;
+		else if (sscanf(line, "DWIDTH %d", &a)==1)
+			advance = a;
+		else if (sscanf(line, "BBX %d %d %d %d", &bw, &bh, &bx, &by)==4)
+			continue;
+		else if (!strncmp(line, "BITMAP", 6)) {
+			int height = ascent + descent, bpr = (bw + 7) / 8;
+			if (!font || ascent<0 || descent<0 || height<1 || height>255 || bw<0 || bw>255 ||
+					bh<0 || advance<0 || advance>255 || bx<-128 || bx>127) {
+				fprintf(stderr, "fontconv: %s is not a font fontconv can convert\n", path);
+				fclose(f);
+				return false;
+			}
+			glyph g;
+			g.code = code;
+			g.width = bw;
+			g.left = bx;
+			g.advance = advance;
+			g.rows = (unsigned char*)calloc(bpr * height + 1, 1);
+			// BBX rows from the top, the lowest by rows above the baseline
+			for (int j=0; j<bh && fgets(line, sizeof(line), f); j++) {
+				int row = ascent - by - bh + j;
+				for (int k=0; k<bpr && row>=0 && row<height; k++) {
+					unsigned int v = 0;
+					if (sscanf(line + k * 2, "%2x", &v)==1)
+						g.rows[row * bpr + k] = v;
+				}
+			}
+			if (bw % 8 && bpr)
+				for (int row=0; row<height; row++)
+					g.rows[row * bpr + bpr - 1] &= 0xFF << (8 - bw % 8);
+			if (code<0 || code>0x10FFFF || !wanted(code) || count==65535) {
+				free(g.rows);
+				continue;
+			}
+			glyphs = (glyph*)realloc(glyphs, (count + 1) * sizeof(glyph));
+			glyphs[count++] = g;
+		} else if (!strncmp(line, "ENDCHAR", 7))
+			code = -1;
+	}
+	fclose(f);
+	if (!count) {
+		fprintf(stderr, "fontconv: no glyphs in %s\n", path);
+		return false;
+	}
+	qsort(glyphs, count, sizeof(glyph), byCode);
+	for (int i=1; i<count; i++)
+		if (glyphs[i].code==glyphs[i - 1].code) {
+			fprintf(stderr, "fontconv: code point %X twice in %s\n", glyphs[i].code, path);
+			return false;
+		}
+	return true;
+}
+
+// Kerning pairs of the glyphs there are, sorted.
+pair* readKerning(const char *path, int &n) {
+	FILE *f = fopen(path, "r");
+	char line[256];
+	pair *pairs = NULL;
+
+	n = 0;
+	if (!f) {
+		perror(path);
+		return NULL;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		unsigned int a, b;
+		int adjust;
+		if (sscanf(line, "%x %x %d", &a, &b, &adjust)!=3 || !adjust || n==65535)
+			continue;
+		pair p = { findGlyph(a), findGlyph(b), adjust };
+		if (p.left<0 || p.right<0)
+			continue;
+		pairs = (pair*)realloc(pairs, (n + 1) * sizeof(pair));
+		pairs[n++] = p;
+	}
+	fclose(f);
+	qsort(pairs, n, sizeof(pair), byGlyphs);
+	return pairs;
+}
+
+// Whether glyph i ends the range that starts at glyph first.
+bool lastOfRange(int i, int first) {
+	return i + 1==count || glyphs[i + 1].code!=glyphs[i].code + 1 || i + 1 - first>=65535;
+}
+
+void put16(unsigned char *p, unsigned int v) {
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+void put32(unsigned char *p, unsigned int v) {
+	put16(p, v);
+	put16(p + 2, v >> 16);
+}
+
+int main(int argc, char *argv[]) {
+	const char *kern = NULL, *name = NULL, *in = NULL, *out = NULL;
+
+	for (int i=1; i<argc; i++) {
+		unsigned int a, b;
+		if (!strcmp(argv[i], "-range") && i + 1<argc && nranges<64 &&
+				sscanf(argv[++i], "%x-%x", &a, &b)==2) {
+			ranges[nranges][0] = a;
+			ranges[nranges++][1] = b;
+		} else if (!strcmp(argv[i], "-kern") && i + 1<argc)
+			kern = argv[++i];
+		else if (!strcmp(argv[i], "-c") && i + 1<argc)
+			name = argv[++i];
+		else if (argv[i][0]!='-' && !in)
+			in = argv[i];
+		else if (argv[i][0]!='-' && !out)
+			out = argv[i];
+		else {
+			in = NULL;
+			break;
+		}
+	}
+	if (!in || !out) {
+		fprintf(stderr, "usage: fontconv [-range first-last] [-kern file] [-c name] font.bdf out\n");
+		return 2;
+	}
+
+	int ascent, descent, npairs = 0;
+	if (!readBDF(in, ascent, descent))
+		return 1;
+	pair *pairs = kern ? readKerning(kern, npairs) : NULL;
+	int height = ascent + descent;
+
+	// a range for every run of consecutive code points
+	int nr = 0;
+	for (int i=0, first=0; i<count; i++)
+		if (lastOfRange(i, first)) {
+			nr++;
+			first = i + 1;
+		}
+
+	long tables = FONT_HEADER + count * 8L + nr * 8L + npairs * 6L, size = tables;
+	for (int i=0; i<count; i++)
+		size += (glyphs[i].width + 7) / 8 * height;
+	if (size>0xFFFFFFFFL) {
+		fprintf(stderr, "fontconv: font too large\n");
+		return 1;
+	}
+	unsigned char *data = (unsigned char*)calloc(size, 1);
+	memcpy(data, FONT_MAGIC, 4);
+	put32(data + 4, size);
+	data[8] = height;
+	data[9] = ascent;
+	put16(data + 10, count);
+	put16(data + 12, nr);
+	put16(data + 14, npairs);
+
+	unsigned char *p = data + FONT_HEADER, *r = p + count * 8L;
+	long offset = tables;
+	int first = 0;
+	for (int i=0; i<count; i++, p+=8) {
+		glyph *g = &glyphs[i];
+		int bytes = (g->width + 7) / 8 * height;
+		put32(p, offset);
+		p[4] = g->width;
+		p[5] = (signed char)g->left;
+		p[6] = g->advance;
+		memcpy(data + offset, g->rows, bytes);
+		offset += bytes;
+		if (lastOfRange(i, first)) {
+			put32(r, glyphs[first].code);
+			put16(r + 4, i + 1 - first);
+			put16(r + 6, first);
+			r += 8;
+			first = i + 1;
+		}
+	}
+	for (int i=0; i<npairs; i++, r+=6) {
+		put16(r, pairs[i].left);
+		put16(r + 2, pairs[i].right);
+		put16(r + 4, pairs[i].adjust);
+	}
+
+	FILE *f = fopen(out, name ? "w" : "wb");
+	if (!f) {
+		perror(out);
+		return 1;
+	}
+	if (!name)
+		fwrite(data, size, 1, f);
+	else {
+		fprintf(f, "// %s, converted by fontconv from %s\n", name, in);
+		fprintf(f, "// Font Size\t: proportional, %d rows\n", height);
+		fprintf(f, "// Memory usage\t: %ld bytes\n", size);
+		fprintf(f, "// # characters\t: %d\n", count);
+		fprintf(f, "#ifndef fontdatatype\n#define fontdatatype const unsigned char\n#endif\n\n");
+		fprintf(f, "fontdatatype %s[%ld] ={\n", name, size);
+		for (long i=0; i<size; i++)
+			fprintf(f, "0x%02X%s", data[i], i + 1==size ? "\n};\n" : (i + 1) % 16 ? "," : ",\n");
+	}
+	if (fclose(f)) {
+		perror(out);
+		return 1;
+	}
+	printf("%d glyphs, %d ranges, %d kerning pairs, %d rows, %ld bytes\n", count, nr, npairs,
+		height, size);
+	return 0;
+}
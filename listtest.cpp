@@ -0,0 +1,201 @@
+/*
+  listtest.cpp - Checks display lists against immediate drawing.
+  Copyright (C)2015 Daniel Donantueno. All right reserved
+
+  Draws every primitive a display list records on memory surfaces of
+  every pixel format, once immediately, once recorded and drawn on one
+  thread and once drawn in tiles on several threads, and reports the
+  cases whose pixels are not the same. Each primitive is drawn alone on
+  a fresh display, then all of them in a row.
+
+  Build:  g++ -O2 -pthread -I. listtest.cpp RTFT.cpp -o listtest
+  Usage:  listtest
+          exits with 1 when a case differs
+
+  Repository https://github.com/dhdonantueno/RTFT.git
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the CC BY-NC-SA 3.0 license.
+  Please see the included documents for further information.
+*/
+
+#include <RTFT.h>
+
+#define W 300
+#define H 130
+
+static unsigned short bitmap[32 * 32];
+static unsigned char mask[32 * 32];
+static const _point star[5] = { {150, 10}, {180, 110}, {100, 45}, {200, 45}, {120, 110} };
+static RTFT source;
+
+void drawRect(RTFT &d) { d.drawRect(10, 10, 140, 100); }
+void drawRoundRect(RTFT &d) { d.drawRoundRect(20, 15, 200, 120, 12); }
+void fillRect(RTFT &d) { d.fillRect(10, 10, 100, 100); }
+// touching boxes the list joins when their state is the same
+void fillRects(RTFT &d) {
+	unsigned char a = d.getAlpha();
+	d.setAlpha(64);
+	d.fillRect(10, 10, 50, 50);
+	d.setAlpha(a);
+	d.fillRect(51, 10, 90, 50);
+	d.fillRect(10, 51, 50, 90);
+}
+// colors set by channel keep all their bits on 24 and 32 bit pixels
+void rgbColors(RTFT &d) {
+	d.setColor(200, 100, 50);
+	d.setBackColor(20, 40, 60);
+	d.fillRect(150, 20, 250, 60);
+	d.setFont(SmallFont);
+	d.print((char*)"RGB", 160, 80);
+}
+void fillRoundRect(RTFT &d) { d.fillRoundRect(30, 5, 250, 90, 20); }
+void drawCircle(RTFT &d) { d.drawCircle(150, 65, 60); }
+void fillCircle(RTFT &d) { d.fillCircle(70, 64, 50); }
+void fillScr(RTFT &d) { d.fillScr(0x00FF); }
+void drawPixel(RTFT &d) { d.drawPixel(63, 31); d.drawPixel(64, 32, 0x00FF); }
+void drawLine(RTFT &d) { d.drawLine(3, 120, 290, 7); }
+void drawHLine(RTFT &d) { d.drawHLine(5, 64, 280); }
+void drawVLine(RTFT &d) { d.drawVLine(128, 2, 120); }
+void print(RTFT &d) { d.setFont(SmallFont); d.print((char*)"Tiles 0x00FF", 40, 60); }
+void printTransparent(RTFT &d) { d.setFont(BigFont, true); d.print((char*)"ABC", 60, 20); }
+void rotateChar(RTFT &d) { d.setFont(BigFont); d.print((char*)"Rot", 150, 60, 30); }
+void printBox(RTFT &d) {
+	d.setFont(SmallFont);
+	d.printBox("Alarm 2: tank 4 level low, refill before 18:00", 20, 20, 200, 80,
+		TEXT_WRAP | TEXT_CENTER);
+}
+void drawBitmap(RTFT &d) { d.drawBitmap(60, 50, 32, 32, bitmap); }
+void drawBitmapStride(RTFT &d) { d.drawBitmap(200, 70, 16, 16, bitmap + 8, 32); }
+void rotateBitmap(RTFT &d) { d.drawBitmap(100, 40, 32, 32, bitmap, 45, 16, 16); }
+void copyBitmap(RTFT &d) { d.drawBitmap(50, 40, source, 0, 0, 63, 47); }
+// a copy from the display itself sees what was drawn before it only
+void selfCopy(RTFT &d) {
+	unsigned short c = d.getColor();
+	d.setColor(0xF800);
+	d.fillRect(0, 0, 9, 9);
+	d.drawBitmap(50, 50, d, 0, 0, 9, 9);
+	d.setColor(0x07E0);
+	d.fillRect(0, 0, 9, 9);
+	d.setColor(c);
+}
+void fillMask(RTFT &d) { d.fillMask(120, 60, 32, 32, mask); }
+void drawBitmapMask(RTFT &d) { d.drawBitmapMask(40, 70, 32, 32, bitmap, mask); }
+void drawLineAA(RTFT &d) { d.drawLineAA(5, 5, 295, 125); }
+void drawArcAA(RTFT &d) { d.drawArcAA(150, 65, 55, 20, 300); }
+void fillTriangle(RTFT &d) { d.fillTriangle(10, 120, 150, 3, 290, 100); }
+void fillPolygon(RTFT &d) { d.fillPolygon(star, 5, FILL_NONZERO); }
+void fillPie(RTFT &d) { d.fillPie(150, 65, 60, 30, 250); }
+void fillArc(RTFT &d) { d.fillArc(150, 65, 60, 12, 200, 90); }
+void drawEllipse(RTFT &d) { d.drawEllipse(150, 65, 120, 40); }
+void fillEllipse(RTFT &d) { d.fillEllipse(150, 65, 80, 50); }
+
+struct primitive {
+	const char *name;
+	void (*draw)(RTFT &d);
+};
+
+static const primitive primitives[] = {
+	{ "drawRect", drawRect }, { "drawRoundRect", drawRoundRect }, { "fillRect", fillRect },
+	{ "fillRects", fillRects }, { "fillRoundRect", fillRoundRect }, { "drawCircle", drawCircle },
+	{ "fillCircle", fillCircle }, { "rgbColors", rgbColors },
+	{ "fillScr", fillScr }, { "drawPixel", drawPixel }, { "drawLine", drawLine },
+	{ "drawHLine", drawHLine }, { "drawVLine", drawVLine }, { "print", print },
+	{ "printTransparent", printTransparent }, { "rotateChar", rotateChar },
+	{ "printBox", printBox }, { "drawBitmap", drawBitmap }, { "drawBitmapStride", drawBitmapStride },
+	{ "rotateBitmap", rotateBitmap }, { "copyBitmap", copyBitmap }, { "fillMask", fillMask },
+	{ "selfCopy", selfCopy },
+	{ "drawBitmapMask", drawBitmapMask }, { "drawLineAA", drawLineAA }, { "drawArcAA", drawArcAA },
+	{ "fillTriangle", fillTriangle }, { "fillPolygon", fillPolygon }, { "fillPie", fillPie },
+	{ "fillArc", fillArc }, { "drawEllipse", drawEllipse }, { "fillEllipse", fillEllipse },
+};
+#define PRIMITIVES (int)(sizeof(primitives) / sizeof(primitives[0]))
+
+// The drawing state of a case, set before the primitives.
+struct state {
+	unsigned short color;
+	unsigned short back;
+	unsigned char alpha;
+};
+
+static const state states[] = {
+	{ 0x00FF, 0x0000, 255 }, { 0xF81F, 0x00FF, 255 }, { 0x07E0, 0xFFFF, 96 },
+};
+#define STATES (int)(sizeof(states) / sizeof(states[0]))
+
+// Draws primitive p, or all of them for -1.
+void scene(RTFT &d, int p, const state &s) {
+	d.setColor(s.color);
+	d.setBackColor(s.back);
+	d.setAlpha(s.alpha);
+	for (int i=0; i<PRIMITIVES; i++)
+		// a copy from the display keeps the whole scene off the tiles
+		if (p<0 ? primitives[i].draw!=selfCopy : p==i) {
+			primitives[i].draw(d);
+			// vary the colors along the whole scene
+			if (p<0)
+				d.setColor(d.getColor() * 31 + 0x0841);
+		}
+}
+
+// The state a list is drawn from, and the one it leaves.
+void resetState(RTFT &d) {
+	d.setColor(233, 77, 11);
+	d.setBackColor(0);
+	d.setAlpha(255);
+}
+
+// Draws the case on d, with a list drawn on threads unless 0.
+void draw(RTFT &d, unsigned char format, int threads, int p, const state &s) {
+	d.initMemory(W, H, format);
+	d.fillScr(0x1234);
+	if (!threads)
+		scene(d, p, s);
+	else {
+		RTFTList list;
+		d.setThreads(threads);
+		d.beginList(&list);
+		scene(d, p, s);
+		d.endList();
+		resetState(d);
+		d.drawList(&list);
+	}
+	// drawn in the state drawList() gives back
+	if (!threads)
+		resetState(d);
+	d.fillRect(0, H - 10, 20, H - 1);
+}
+
+int main() {
+	static const int threads[] = { 1, 2, 4, MAX_THREADS };
+	int failed = 0, cases = 0;
+
+	for (int i=0; i<32 * 32; i++) {
+		bitmap[i] = i * 0x0821 ^ (i >> 5) * 0x1004;
+		mask[i] = (i % 32) * 8 + (i / 32);
+	}
+	source.initMemory(64, 48);
+	source.fillScr(0x0410);
+	source.setColor(0xFFE0);
+	source.fillCircle(32, 24, 20);
+
+	for (unsigned char format=PIXFMT_INDEXED8; format<=PIXFMT_XBGR8888; format++)
+		for (int s=0; s<STATES; s++)
+			for (int p=-1; p<PRIMITIVES; p++) {
+				RTFT immediate;
+				draw(immediate, format, 0, p, states[s]);
+				long size = (long)immediate.getSurface()->stride * H;
+				for (unsigned t=0; t<sizeof(threads) / sizeof(threads[0]); t++) {
+					RTFT listed;
+					draw(listed, format, threads[t], p, states[s]);
+					cases++;
+					if (memcmp(immediate.getPixels(), listed.getPixels(), size)) {
+						printf("format %d state %d %s, list on %d threads: differs\n", format, s,
+							p<0 ? "scene" : primitives[p].name, threads[t]);
+						failed++;
+					}
+				}
+			}
+	printf("%d cases, %d failed\n", cases, failed);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,207 @@
+/*
+  view.cpp - Reference client for the RTFT remote view.
+  Copyright (C)2015 Daniel Donantueno. All right reserved
+
+  Connects to a program serving its screen with RTFT::startServer(),
+  rebuilds every frame it is sent from the changed tiles and writes it
+  to disk as a PPM picture named after the frame number, so gaps in the
+  numbers are the frames skipped by the server's rate limit.
+
+  Build:  g++ -O2 -I. view.cpp -o view
+  Usage:  view [-tcp port] [-frames n] [-out prefix] [socket]
+          -tcp     connect to port on 127.0.0.1 instead of a socket
+          -frames  stop after n frames, when the server closes by default
+          -out     prefix of the pictures, frame_ by default
+          socket   path of the Unix domain socket, /tmp/rtft.sock by default
+
+  Repository https://github.com/dhdonantueno/RTFT.git
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the CC BY-NC-SA 3.0 license.
+  Please see the included documents for further information.
+*/
+
+#include <RTFT.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+
+bool readAll(int fd, void *buf, long n) {
+	char *p = (char*)buf;
+	while (n>0) {
+		ssize_t k = read(fd, p, n);
+		if (k<0 && errno==EINTR)
+			continue;
+		if (k<=0)
+			return false;
+		p += k;
+		n -= k;
+	}
+	return true;
+}
+
+// Unpacks runs of n pixels of bypp bytes, false when in holds anything
+// else.
+bool unpackRuns(const unsigned char *in, long len, int n, int bypp, unsigned char *out) {
+	long k = 0;
+	int i = 0;
+	while (i<n && k<len) {
+		int c = in[k++];
+		if (c<128) {
+			if (i + c + 1>n || k + (c + 1) * bypp>len)
+				return false;
+			memcpy(out + i * bypp, in + k, (c + 1) * bypp);
+			k += (c + 1) * bypp;
+			i += c + 1;
+		} else {
+			if (i + c - 126>n || k + bypp>len)
+				return false;
+			for (int j=0; j<c - 126; j++)
+				memcpy(out + (i + j) * bypp, in + k, bypp);
+			k += bypp;
+			i += c - 126;
+		}
+	}
+	return i==n && k==len;
+}
+
+// The RGB24 pixels of a tile into pix, false when it is malformed.
+bool decodeTile(const _remote_tile *t, const unsigned char *in, unsigned char *pix, unsigned char *idx) {
+	int n = t->w * t->h;
+	if (t->encoding==REMOTE_RUNS)
+		return unpackRuns(in, t->bytes, n, 3, pix);
+	if (t->encoding!=REMOTE_PALETTE || t->colors<1 || t->colors>16 || t->bytes<t->colors * 3u)
+		return false;
+
+	int bits = t->colors<=2 ? 1 : t->colors<=4 ? 2 : 4;
+	int per = 8 / bits;
+	int row = (t->w + per - 1) / per;
+	if (!unpackRuns(in + t->colors * 3, t->bytes - t->colors * 3, row * t->h, 1, idx))
+		return false;
+	for (int y=0; y<t->h; y++)
+		for (int x=0; x<t->w; x++) {
+			int b = idx[y * row + x / per];
+			int c = b >> (8 - bits - x % per * bits) & ((1 << bits) - 1);
+			if (c>=t->colors)
+				return false;
+			memcpy(pix + (y * t->w + x) * 3, in + c * 3, 3);
+		}
+	return true;
+}
+
+bool savePicture(const char *path, const unsigned char *rgb, int w, int h) {
+	FILE *f = fopen(path, "wb");
+	if (!f)
+		return false;
+	bool ok = fprintf(f, "P6\n%d %d\n255\n", w, h)>0 && fwrite(rgb, w * 3, h, f)==(size_t)h;
+	return fclose(f)==0 && ok;
+}
+
+int main(int argc, char *argv[]) {
+	const char *path = "/tmp/rtft.sock";
+	const char *prefix = "frame_";
+	int port = 0;
+	long frames = -1;
+
+	for (int i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "-tcp") && i + 1<argc)
+			port = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-frames") && i + 1<argc)
+			frames = atol(argv[++i]);
+		else if (!strcmp(argv[i], "-out") && i + 1<argc)
+			prefix = argv[++i];
+		else if (argv[i][0]!='-')
+			path = argv[i];
+		else {
+			fprintf(stderr, "usage: view [-tcp port] [-frames n] [-out prefix] [socket]\n");
+			return 2;
+		}
+	}
+
+	int fd;
+	if (port) {
+		struct sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (fd>=0 && connect(fd, (struct sockaddr*)&addr, sizeof(addr))) {
+			close(fd);
+			fd = -1;
+		}
+	} else {
+		struct sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd>=0 && connect(fd, (struct sockaddr*)&addr, sizeof(addr))) {
+			close(fd);
+			fd = -1;
+		}
+	}
+	if (fd<0) {
+		perror("view: connect");
+		return 1;
+	}
+
+	_capture_header hd;
+	if (!readAll(fd, &hd, sizeof(hd)) || hd.magic!=REMOTE_MAGIC || hd.bytes!=3) {
+		fprintf(stderr, "view: not a remote view stream\n");
+		return 1;
+	}
+	int w = hd.width, h = hd.height;
+	unsigned char *screen = (unsigned char*)calloc((long)w * h, 3);
+	unsigned char *pix = (unsigned char*)malloc(hd.tile_w * hd.tile_h * 3);
+	unsigned char *idx = (unsigned char*)malloc(hd.tile_w * hd.tile_h);
+	unsigned char *data = NULL;
+	unsigned long size = 0, received = sizeof(hd);
+	long count = 0;
+	printf("%dx%d, tiles %dx%d\n", w, h, hd.tile_w, hd.tile_h);
+
+	_capture_frame f;
+	while (count!=frames && readAll(fd, &f, sizeof(f))) {
+		if (f.magic!=CAPTURE_FRAME_MAGIC) {
+			fprintf(stderr, "view: lost the frames\n");
+			return 1;
+		}
+		if (f.bytes>size) {
+			size = f.bytes;
+			data = (unsigned char*)realloc(data, size);
+		}
+		if (!data || !readAll(fd, data, f.bytes))
+			break;
+		received += sizeof(f) + f.bytes;
+
+		unsigned long k = 0;
+		for (unsigned int i=0; i<f.tiles; i++) {
+			_remote_tile t;
+			bool ok = k + sizeof(t)<=f.bytes;
+			if (ok) {
+				memcpy(&t, data + k, sizeof(t));
+				k += sizeof(t);
+				ok = k + t.bytes<=f.bytes && t.w<=hd.tile_w && t.h<=hd.tile_h &&
+					t.x + t.w<=w && t.y + t.h<=h && decodeTile(&t, data + k, pix, idx);
+			}
+			if (!ok) {
+				fprintf(stderr, "view: bad tile in frame %u\n", f.frame);
+				return 1;
+			}
+			k += t.bytes;
+			for (int y=0; y<t.h; y++)
+				memcpy(screen + ((long)(t.y + y) * w + t.x) * 3, pix + y * t.w * 3, t.w * 3);
+		}
+
+		char name[4096];
+		snprintf(name, sizeof(name), "%s%06u.ppm", prefix, f.frame);
+		if (!savePicture(name, screen, w, h)) {
+			perror(name);
+			return 1;
+		}
+		count++;
+	}
+	printf("%ld frames, %lu bytes\n", count, received);
+	close(fd);
+	return 0;
+}